@@ -57,7 +57,7 @@ public:
 		std::vector<std::pair<u32, u32>> mMap;
 	};
 
-	BFFNT(const std::vector<u8>& fileContents) : mContents(fileContents) {}
+	BFFNT(std::span<const u8> fileContents) : mContents(fileContents) {}
 
 	result_t read();
 	result_t readHeader(const u8* offset);
@@ -67,7 +67,7 @@ public:
 	result_t readCMAP(CMAP* cmap, const u8* offset);
 
 private:
-	const std::vector<u8>& mContents;
+	std::span<const u8> mContents;
 	util::ByteOrder mByteOrder;
 	FINF mFontInfo;
 	TGLP mTexGlyph;
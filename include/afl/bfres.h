@@ -555,8 +555,8 @@ private:
 
 class Reader {
 public:
-	Reader(const std::vector<u8>& fileContents) :
-		mContents(fileContents), mBase(&mContents[0]) {}
+	Reader(std::span<const u8> fileContents) :
+		mContents(fileContents), mBase(mContents.data()) {}
 
 	result_t read();
 	result_t readHeader(const u8* offset);
@@ -571,7 +571,7 @@ public:
 	u64 getGPUBufferOffset() const { return mBufferInfo->getBufferOffset(); }
 
 private:
-	const std::vector<u8>& mContents;
+	std::span<const u8> mContents;
 	const u8* mBase;
 	util::ByteOrder mByteOrder;
 
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <bit>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "afl/types.h"
+#include "afl/util.h"
+
+namespace util {
+
+// writes binary data into a buffer in a byte order chosen at construction. writes go to the
+// current position and move it forward. the buffer only grows when a write goes past its end,
+// and any gap left by `seek` or `align` is filled with zeros at that point
+class BinaryWriter {
+public:
+	// position of a u32 which is filled in later with `patchU32`
+	struct Slot {
+		size_t mOffset;
+	};
+
+	// replaces the contents of `buffer`. `capacity` is reserved up front if the final size is
+	// known or can be estimated
+	BinaryWriter(std::vector<u8>& buffer, ByteOrder byteOrder, size_t capacity = 0);
+
+	ByteOrder getByteOrder() const { return mByteOrder; }
+
+	size_t tell() const { return mPos; }
+
+	void seek(size_t offset) { mPos = offset; }
+
+	void align(u32 alignment) { mPos = (mPos + alignment - 1) & ~size_t(alignment - 1); }
+
+	void reserve(size_t capacity) { mBuffer.reserve(capacity); }
+
+	void writeU8(u8 value) { *grow(1) = value; }
+
+	void writeU16(u16 value) { writeValue(value); }
+
+	void writeU24(u32 value);
+
+	void writeU32(u32 value) { writeValue(value); }
+
+	void writeS32(s32 value) { writeValue(value); }
+
+	void writeF32(f32 value) { writeValue(value); }
+
+	void writeU64(u64 value) { writeValue(value); }
+
+	void writeS64(s64 value) { writeValue(value); }
+
+	void writeF64(f64 value) { writeValue(value); }
+
+	void writeString(std::string_view str, bool isNullTerminated = true);
+	void writeBytes(std::span<const u8> bytes);
+
+	template <typename T>
+	void writeArray(std::span<const T> values) {
+		if (values.empty()) return;
+
+		u8* ptr = grow(values.size_bytes());
+		if (sizeof(T) > 1 && mNeedsSwap)
+			byteswapArray(ptr, values.data(), values.size(), sizeof(T));
+		else
+			std::memcpy(ptr, values.data(), values.size_bytes());
+	}
+
+	// writes a placeholder for a value which isn't known yet
+	Slot reserveU32();
+	void patchU32(Slot slot, u32 value);
+
+private:
+	// makes room for `size` bytes at the current position, and returns a pointer to them
+	u8* grow(size_t size) {
+		size_t end = mPos + size;
+		if (end > mBuffer.size()) mBuffer.resize(end);
+
+		u8* ptr = mBuffer.data() + mPos;
+		mPos = end;
+		return ptr;
+	}
+
+	template <typename T>
+	void writeValue(T value) {
+		using U =
+			std::conditional_t<sizeof(T) == 2, u16, std::conditional_t<sizeof(T) == 4, u32, u64>>;
+
+		U raw = std::bit_cast<U>(value);
+		if (mNeedsSwap) raw = byteswap(raw);
+
+		std::memcpy(grow(sizeof(T)), &raw, sizeof(T));
+	}
+
+	std::vector<u8>& mBuffer;
+	const ByteOrder mByteOrder;
+	const bool mNeedsSwap;
+	size_t mPos = 0;
+};
+
+} // namespace util
@@ -6,12 +6,12 @@
 
 class BNTX {
 public:
-	BNTX(const std::vector<u8>& fileContents) : mContents(fileContents) {}
+	BNTX(std::span<const u8> fileContents) : mContents(fileContents) {}
 
 	result_t read();
 	result_t readHeader(const u8* offset);
 
 private:
-	const std::vector<u8>& mContents;
+	std::span<const u8> mContents;
 	util::ByteOrder mByteOrder;
 };
@@ -9,6 +9,7 @@ class Reader {
 public:
 	Reader();
 	result_t init(const u8* fileData);
+	result_t init(std::span<const u8> fileData);
 	result_t init(const Reader& other, const u32 offset);
 
 	const std::string getHashString(u32 idx) const;
@@ -117,6 +118,7 @@ private:
 	result_t initHeader();
 	void initKeyOrder();
 
+	const u8* findChild(const std::string& key) const;
 	result_t getNodeByKey(const u8** offset, const std::string& key, NodeType expectedType) const;
 	result_t getNodeByIdx(const u8** offset, u32 idx, NodeType expectedType) const;
 	result_t getContainerOffsets(const u8** typeOffset, const u8** valueOffset, u32 idx) const;
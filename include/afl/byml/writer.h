@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 
+#include "afl/binarywriter.h"
 #include "afl/byml/common.h"
 #include "afl/util.h"
 
@@ -29,14 +30,14 @@ private:
 		virtual ~Node() {}
 
 		virtual u32 calcSize() const = 0;
-		virtual void write(std::vector<u8>& outputBuffer, u32 offset) const = 0;
+		virtual void write(util::BinaryWriter& writer) const = 0;
 
 		NodeType mType;
 	};
 
 	struct StringTable {
 		void addString(const std::string& string);
-		void write(std::vector<u8>& outputBuffer, u32 offset) const;
+		void write(util::BinaryWriter& writer) const;
 		u32 find(const std::string& string) const;
 
 		u32 size() const { return mStrings.size(); }
@@ -60,10 +61,10 @@ private:
 		Container(NodeType type) : Node(type) {}
 
 		virtual size_t size() const = 0;
-		virtual void writeContainer(std::vector<u8>& outputBuffer) const = 0;
+		virtual void writeContainer(util::BinaryWriter& writer) const = 0;
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeU32LE(outputBuffer, offset, mOffset);
+		void write(util::BinaryWriter& writer) const override {
+			writer.writeU32(mOffset);
 		}
 
 		void setOffset(u32 offset) { mOffset = offset; }
@@ -74,7 +75,7 @@ private:
 	struct Array : Container {
 		Array() : Container(NodeType::Array) {}
 
-		void writeContainer(std::vector<u8>& outputBuffer) const override;
+		void writeContainer(util::BinaryWriter& writer) const override;
 
 		size_t size() const override { return mNodes.size(); }
 
@@ -90,7 +91,7 @@ private:
 		Hash(const StringTable& hashKeyStringTable) :
 			Container(NodeType::Hash), mHashKeyStringTable(hashKeyStringTable) {}
 
-		void writeContainer(std::vector<u8>& outputBuffer) const override;
+		void writeContainer(util::BinaryWriter& writer) const override;
 
 		size_t size() const override { return mNodes.size(); }
 
@@ -110,9 +111,9 @@ private:
 		String(const std::string& value, const StringTable& valueStringTable) :
 			ValueNode(NodeType::String), mValueStringTable(valueStringTable), mValue(value) {}
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
+		void write(util::BinaryWriter& writer) const override {
 			u32 index = mValueStringTable.find(mValue);
-			writer::writeU32LE(outputBuffer, offset, index);
+			writer.writeU32(index);
 		}
 
 		const StringTable& mValueStringTable;
@@ -122,8 +123,8 @@ private:
 	struct Bool : ValueNode {
 		Bool(bool value) : ValueNode(NodeType::Bool), mValue(value) {}
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeU32LE(outputBuffer, offset, mValue);
+		void write(util::BinaryWriter& writer) const override {
+			writer.writeU32(mValue);
 		}
 
 		bool mValue;
@@ -132,8 +133,8 @@ private:
 	struct S32 : ValueNode {
 		S32(s32 value) : ValueNode(NodeType::S32), mValue(value) {}
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeS32LE(outputBuffer, offset, mValue);
+		void write(util::BinaryWriter& writer) const override {
+			writer.writeS32(mValue);
 		}
 
 		s32 mValue;
@@ -142,8 +143,8 @@ private:
 	struct F32 : ValueNode {
 		F32(f32 value) : ValueNode(NodeType::F32), mValue(value) {}
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeF32LE(outputBuffer, offset, mValue);
+		void write(util::BinaryWriter& writer) const override {
+			writer.writeF32(mValue);
 		}
 
 		f32 mValue;
@@ -152,8 +153,8 @@ private:
 	struct U32 : ValueNode {
 		U32(u32 value) : ValueNode(NodeType::U32), mValue(value) {}
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeU32LE(outputBuffer, offset, mValue);
+		void write(util::BinaryWriter& writer) const override {
+			writer.writeU32(mValue);
 		}
 
 		u32 mValue;
@@ -162,20 +163,20 @@ private:
 	struct Null : ValueNode {
 		Null() : ValueNode(NodeType::Null) {}
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeU32LE(outputBuffer, offset, 0);
+		void write(util::BinaryWriter& writer) const override {
+			writer.writeU32(0);
 		}
 	};
 
 	struct Value64Node : Node {
 		Value64Node(NodeType type) : Node(type) {}
 
-		virtual void writeData64(std::vector<u8>& outputBuffer, u32 offset) const = 0;
+		virtual void writeData64(util::BinaryWriter& writer) const = 0;
 
 		u32 calcSize() const override { return 4; }
 
-		void write(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeU32LE(outputBuffer, offset, mOffset);
+		void write(util::BinaryWriter& writer) const override {
+			writer.writeU32(mOffset);
 		}
 
 		void setOffset(u32 offset) { mOffset = offset; }
@@ -186,8 +187,8 @@ private:
 	struct S64 : Value64Node {
 		S64(s64 value) : Value64Node(NodeType::S64), mValue(value) {}
 
-		void writeData64(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeS64LE(outputBuffer, offset, mValue);
+		void writeData64(util::BinaryWriter& writer) const override {
+			writer.writeS64(mValue);
 		}
 
 		s64 mValue;
@@ -196,8 +197,8 @@ private:
 	struct U64 : Value64Node {
 		U64(u64 value) : Value64Node(NodeType::U64), mValue(value) {}
 
-		void writeData64(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeU64LE(outputBuffer, offset, mValue);
+		void writeData64(util::BinaryWriter& writer) const override {
+			writer.writeU64(mValue);
 		}
 
 		u64 mValue;
@@ -206,8 +207,8 @@ private:
 	struct F64 : Value64Node {
 		F64(f64 value) : Value64Node(NodeType::F64), mValue(value) {}
 
-		void writeData64(std::vector<u8>& outputBuffer, u32 offset) const override {
-			writer::writeF64LE(outputBuffer, offset, mValue);
+		void writeData64(util::BinaryWriter& writer) const override {
+			writer.writeF64(mValue);
 		}
 
 		f64 mValue;
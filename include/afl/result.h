@@ -3,6 +3,7 @@
 #include "byml/common.h"
 #include "types.h"
 #include "util.h"
+#include "yaz0.h"
 
 constexpr const char* resultToString(result_t r) {
 	switch (r) {
@@ -18,6 +19,12 @@ constexpr const char* resultToString(result_t r) {
 	case byml::Error::EmptyStack: return "byml: empty stack";
 	case byml::Error::FullStack: return "byml: full stack";
 	case byml::Error::InvalidVersion: return "byml: invalid version";
+	case yaz0::Error::InvalidOffset: return "yaz0: back-reference before start of output";
+	case yaz0::Error::Truncated: return "yaz0: unexpected end of input";
+	case yaz0::Error::OutputTooSmall: return "yaz0: output buffer too small";
+	case yaz0::Error::OutOfRange: return "yaz0: range out of bounds";
+	case yaz0::Error::IndexMismatch: return "yaz0: seek index doesn't match stream";
+	case yaz0::Error::InvalidIndex: return "yaz0: invalid seek index";
 	}
 	return "(unknown)";
 }
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "afl/util.h"
+
+namespace sarc {
+
+struct Header {
+	util::ByteOrder mByteOrder;
+	u32 mFileSize;
+	u32 mDataOffset;
+	u16 mVersion;
+};
+
+// entry in the SFAT. the top byte of `mAttrs` numbers the entries which share a hash from 1 (or
+// is 0 if the entry has no name), and the rest is the offset of the name divided by 4
+struct FileEntry {
+	u32 mHash;
+	u32 mAttrs;
+	u32 mStartOffset;
+	u32 mEndOffset;
+};
+
+// everything in an archive before the file data
+struct Tables {
+	Header mHeader;
+	u32 mHashKey;
+	std::vector<FileEntry> mFiles;
+	// false if the SFAT entries aren't sorted by hash
+	bool mIsSorted;
+	// offset of the names, right after the SFNT header
+	u32 mNameTableOffset;
+};
+
+// reads the header, SFAT and SFNT, and checks that they and the entries' data fit in `contents`
+result_t readTables(Tables* out, std::span<const u8> contents);
+
+u32 calcHash(std::string_view name, u32 key);
+
+// `names` is the name table, up to the start of the data. the name is a view into it, and empty
+// for entries without one
+std::string_view getName(std::span<const u8> names, const FileEntry& file);
+
+// if the entries are sorted, this binary searches for the hash of `name` and only compares names
+// of the entries which share it
+const FileEntry* findFile(
+	std::span<const FileEntry> files, std::span<const u8> names, u32 hashKey,
+	std::string_view name, bool isSorted = true
+);
+
+} // namespace sarc
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+
+#include "afl/sarc/common.h"
+#include "afl/util.h"
+
+namespace sarc {
+
+// edits an archive in its buffer without rebuilding it. data which fits in the entry's current
+// slot is written in place, otherwise only the data after the slot is moved. each entry's data
+// keeps the alignment its offset already has (up to 0x2000, since larger ones are assumed to be
+// by chance), and new entries are aligned to the largest alignment in the archive
+class Editor {
+public:
+	Editor(std::vector<u8>& contents) : mContents(contents) {}
+
+	result_t init();
+
+	result_t replace(std::string_view filename, std::span<const u8> data);
+	// adds a new entry, or replaces the data of an existing one
+	result_t add(std::string_view filename, std::span<const u8> data);
+	// the name stays in the name table, but is cleared
+	result_t remove(std::string_view filename);
+
+	u32 getFileCount() const { return mFiles.size(); }
+
+	// alignment of the data of new entries
+	u32 getAlignment() const { return mAlignment; }
+
+private:
+	using File = FileEntry;
+
+	static constexpr u32 MAX_ALIGNMENT = 0x2000;
+
+	result_t replaceAt(size_t idx, std::span<const u8> data);
+	// the start of the first data after the start of this entry's, if any. this is before the end
+	// of the entry's data if it shares it with other entries
+	u64 getSlotEnd(size_t idx) const;
+	// largest power of 2 that the entry's offset in the archive is a multiple of, up to
+	// `MAX_ALIGNMENT`
+	u32 getAlignment(const File& file) const;
+	// largest alignment of the data from `start` onwards, which a move has to be a multiple of
+	u32 getMoveAlignment(u32 start) const;
+	// offset after all the data for new data with the given alignment
+	u32 getEnd(u32 alignment) const;
+	// moves the data from `start` onwards by `delta` bytes, and updates the entries there
+	void moveData(u32 start, s64 delta);
+	// moves the data further back if the tables would run into it
+	void reserveTables(u32 end);
+
+	// offset of the SFNT header, which comes right after the SFAT entries
+	u32 getSFNTOffset() const { return 0x14 + 0xc + 0x10 * mFiles.size(); }
+
+	// writes `mFiles` and the sizes in the header back into the buffer
+	void writeTables();
+
+	File* findFile(std::string_view name);
+	std::string_view getName(const File& file) const;
+	std::span<const u8> getNames() const;
+
+	std::vector<u8>& mContents;
+	util::ByteOrder mByteOrder = util::ByteOrder::Little;
+	u32 mDataOffset = 0;
+	u32 mHashKey = 101;
+	// end of the last name in the name table, including its null terminator. it isn't rounded up,
+	// so it never runs into the data
+	u32 mNamesSize = 0;
+	u32 mAlignment = 1;
+	std::vector<File> mFiles;
+};
+
+} // namespace sarc
@@ -1,43 +1,84 @@
 #pragma once
 
 #include <set>
+#include <string_view>
 
+#include "afl/sarc/common.h"
 #include "afl/util.h"
 
 namespace sarc {
 
 class Reader {
 public:
-	struct Header {
-		util::ByteOrder mByteOrder;
-		u32 mFileSize;
-		u32 mDataOffset;
-		u16 mVersion;
-	};
+	using Header = sarc::Header;
+	using File = FileEntry;
 
-	struct File {
+	struct Entry {
+		std::string_view mName;
+		std::span<const u8> mData;
 		u32 mHash;
-		u32 mAttrs;
-		u32 mStartOffset;
-		u32 mEndOffset;
-		std::string mName;
 	};
 
-	Reader(const std::vector<u8>& fileContents) : mContents(fileContents) {}
+	// walks the entries in SFAT order. names are only looked up when an entry is dereferenced
+	class EntryIterator {
+	public:
+		EntryIterator(const Reader* reader, u32 idx) : mReader(reader), mIdx(idx) {}
+
+		Entry operator*() const { return mReader->getEntry(mIdx); }
+
+		EntryIterator& operator++() {
+			mIdx++;
+			return *this;
+		}
+
+		bool operator==(const EntryIterator& other) const { return mIdx == other.mIdx; }
+
+	private:
+		const Reader* mReader;
+		u32 mIdx;
+	};
+
+	Reader(std::span<const u8> fileContents) : mContents(fileContents) {}
 
 	result_t init();
-	result_t initHeader(const u8* offset);
-	result_t readSFAT(const u8* offset);
-	result_t readSFNT(const u8* offset);
 	const std::set<std::string> getFilenames();
 	result_t saveFile(const std::string& outDir, const std::string& filename);
-	result_t saveAll(const std::string& outDir);
+	// writes every named entry below `outDir`. a `threadCount` other than 1 writes entries from that
+	// many threads (0 uses every core), and `preallocate` reserves each file's size before writing
+	// where the platform supports it
+	result_t saveAll(const std::string& outDir, u32 threadCount = 1, bool preallocate = false);
 	result_t getFileData(std::vector<u8>& out, const std::string& filename);
 	result_t getFileSize(u32* out, const std::string& filename);
 
+	// views into the archive buffer, which stay valid for as long as the buffer does
+	result_t getFileView(std::span<const u8>* out, const std::string& filename) const;
+	result_t getFileViewByIndex(std::span<const u8>* out, u32 idx) const;
+	// largest power of two that the entry's offset in the archive is a multiple of
+	result_t getFileAlignment(u32* out, const std::string& filename) const;
+	result_t getFileAlignmentByIndex(u32* out, u32 idx) const;
+
+	u32 getFileCount() const { return mFiles.size(); }
+
+	// the name is a view into the SFNT table, and empty for entries without one
+	Entry getEntry(u32 idx) const;
+
+	EntryIterator begin() const { return { this, 0 }; }
+
+	EntryIterator end() const { return { this, getFileCount() }; }
+
 private:
-	const std::vector<u8>& mContents;
+	const File* findFile(std::string_view name) const;
+	std::string_view getName(const File& file) const;
+	std::span<const u8> getNames() const;
+	std::span<const u8> getData(const File& file) const;
+	u32 getAlignment(const File& file) const;
+
+	std::span<const u8> mContents;
 	Header mHeader;
+	u32 mHashKey = 101;
+	// false if the SFAT entries aren't sorted by hash, in which case lookups scan every entry
+	bool mIsSorted = true;
+	size_t mNameTableOffset = 0;
 	std::vector<File> mFiles;
 };
 
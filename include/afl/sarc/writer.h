@@ -1,6 +1,10 @@
 #pragma once
 
+#include <span>
+
+#include "afl/binarywriter.h"
 #include "afl/util.h"
+#include "afl/yaz0.h"
 
 namespace sarc {
 
@@ -14,26 +18,64 @@ public:
 
 		std::string mName;
 		std::vector<u8> mData;
+		// borrowed data, used instead of `mData` if it isn't empty
+		std::span<const u8> mView;
+		// if set, the data is read from this file when saving
+		fs::path mPath;
 	};
 
 	Writer(u16 version = 0x100) : mVersion(version) {}
 
-	void saveToVec(
+	// stores files with identical contents only once, with their entries sharing the data
+	void setDeduplicate(bool deduplicate) { mDeduplicate = deduplicate; }
+
+	result_t saveToVec(
 		std::vector<u8>& out, util::ByteOrder byteOrder = util::ByteOrder::Little,
 		u32 alignment = 0x80
 	);
-	void save(
+	// writes the archive straight to the file. only the header and tables are built in memory,
+	// the file data is written from the added buffers
+	result_t save(
 		const std::string& filename, util::ByteOrder byteOrder = util::ByteOrder::Little,
 		u32 alignment = 0x80
 	);
+	// saves as SZS (Yaz0-compressed SARC). if `cache` is given, an archive which is identical to
+	// one saved before is read back from it instead of being compressed again
+	result_t saveCompressed(
+		const std::string& filename, util::ByteOrder byteOrder = util::ByteOrder::Little,
+		u32 alignment = 0x80, yaz0::Level level = yaz0::Level::Normal,
+		yaz0::Cache* cache = nullptr
+	);
 
 	void addFile(const std::string& filename, const std::vector<u8>& fileData);
+	void addFile(const std::string& filename, std::vector<u8>&& fileData);
+	// `fileData` isn't copied, so it has to stay valid until the archive is saved
+	void addFile(const std::string& filename, std::span<const u8> fileData);
+	// `path` is only read (or mapped) when the archive is saved
+	void addFile(const std::string& filename, const fs::path& path);
 
 private:
-	u32 calcHash(const std::string& str) const;
+	void sortFiles();
+	// layout of the file data in `mFiles` order, worked out before anything is written
+	struct Payloads {
+		std::vector<size_t> mSizes;
+		// index of the file whose data is stored for each file. this is the file itself unless
+		// it's a duplicate of an earlier one
+		std::vector<u32> mSources;
+	};
+
+	result_t loadPayloads(Payloads* payloads) const;
+	// gets the data of a file. files added by path are opened into `mapping`, which has to stay
+	// open for as long as the data is used
+	result_t openData(
+		std::span<const u8>* out, const Payloads& payloads, u32 idx, util::MappedFile* mapping
+	) const;
+	// writes everything up to the start of the file data, and returns the size of the data
+	u32 writeTables(util::BinaryWriter& writer, const Payloads& payloads, u32 alignment) const;
 
 	const u16 mVersion;
 	const u32 mHashMultiplier = 101;
+	bool mDeduplicate = false;
 
 	std::vector<File> mFiles;
 };
@@ -0,0 +1,65 @@
+#pragma once
+
+// SZS (Yaz0-compressed SARC)
+
+#include <memory>
+#include <set>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "afl/sarc/reader.h"
+#include "afl/util.h"
+#include "afl/yaz0.h"
+
+namespace szs {
+
+// an archive which is only decompressed as far as it has been read. `init` decompresses up to the
+// end of the SARC tables, and reading an entry continues up to the end of that entry's data, so
+// entries near the start can be read without decompressing the rest. the compressed data isn't
+// copied, so it has to stay valid for as long as the archive is used
+class Archive {
+public:
+	Archive(std::span<const u8> fileContents) : mCompressed(fileContents) {}
+
+	result_t init();
+
+	u32 getFileCount() const { return mReader ? mReader->getFileCount() : 0; }
+
+	const std::set<std::string> getFilenames() {
+		return mReader ? mReader->getFilenames() : std::set<std::string>();
+	}
+
+	// views into the decompressed archive, which stay valid for as long as the archive does. these
+	// return FileNotFound if `init` hasn't succeeded
+	result_t getFileView(std::span<const u8>* out, const std::string& filename);
+	result_t getFileViewByIndex(std::span<const u8>* out, u32 idx);
+	result_t getFileData(std::vector<u8>& out, const std::string& filename);
+	result_t getEntry(sarc::Reader::Entry* out, u32 idx);
+
+	// decompresses whatever is left, and returns a view of the whole SARC, or FileNotFound like the
+	// accessors above
+	result_t getContents(std::span<const u8>* out);
+
+	u32 getDecompressedSize() const { return mOutputPos; }
+
+	u32 getUncompressedSize() const { return mSize; }
+
+private:
+	// decompresses until at least the first `end` bytes of the SARC are available
+	result_t decompressTo(size_t end);
+	result_t decompressView(std::span<const u8> view);
+
+	std::span<const u8> mCompressed;
+	// where decompression stopped, which is always at the start of a group of tokens
+	size_t mInputPos = 0;
+	u32 mOutputPos = 0;
+
+	// only the first `getDecompressedSize()` bytes are written. the rest is left uninitialized, so
+	// memory is only touched as the archive is decompressed
+	std::unique_ptr<u8[]> mContents;
+	u32 mSize = 0;
+	std::unique_ptr<sarc::Reader> mReader;
+};
+
+} // namespace szs
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "afl/types.h"
+
+namespace util {
+
+// fixed set of worker threads, each with its own queue of tasks. a worker takes the newest task
+// from its own queue, and when that's empty, steals the oldest task from another worker's queue.
+// tasks submitted from inside a worker go to that worker's queue, so work which splits itself up
+// gets spread over the idle threads
+class ThreadPool {
+public:
+	using Task = std::function<void()>;
+
+	// a `threadCount` of 0 uses every available core
+	ThreadPool(u32 threadCount = 0);
+	~ThreadPool();
+
+	void submit(Task task);
+	// blocks until every submitted task has finished. must not be called from inside a task
+	void wait();
+
+	u32 getThreadCount() const { return mThreads.size(); }
+
+private:
+	struct Queue {
+		std::mutex mMutex;
+		std::deque<Task> mTasks;
+	};
+
+	void run(u32 index);
+	bool pop(Task* task, u32 index);
+
+	std::vector<std::unique_ptr<Queue>> mQueues;
+	std::vector<std::thread> mThreads;
+
+	std::mutex mMutex;
+	std::condition_variable mWakeCondition;
+	std::condition_variable mDoneCondition;
+	std::atomic<u32> mQueuedCount = 0;
+	u32 mPendingCount = 0;
+	bool mIsStopping = false;
+	std::atomic<u32> mNextQueue = 0;
+};
+
+} // namespace util
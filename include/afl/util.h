@@ -1,7 +1,11 @@
 #pragma once
 
+#include <bit>
+#include <cstring>
 #include <filesystem>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "afl/types.h"
@@ -27,11 +31,59 @@ enum class ByteOrder {
 u16 bswap16(u16 value);
 u32 bswap32(u32 value);
 
+// whether values in `byteOrder` have to be byte swapped on this host
+constexpr bool needsSwap(ByteOrder byteOrder) {
+	return (byteOrder == ByteOrder::Big) != (std::endian::native == std::endian::big);
+}
+
+// same as C++23's std::byteswap, for unsigned integers
+template <typename T>
+constexpr T byteswap(T value) {
+	if constexpr (sizeof(T) == 2) return __builtin_bswap16(value);
+	else if constexpr (sizeof(T) == 4) return __builtin_bswap32(value);
+	else if constexpr (sizeof(T) == 8) return __builtin_bswap64(value);
+	else return value;
+}
+
+// copies `count` elements of `elemSize` (2, 4 or 8) bytes from `src` to `dst`, reversing the
+// bytes of each one. `dst` may be the same as `src`
+void byteswapArray(void* dst, const void* src, size_t count, u32 elemSize);
+
 bool isEqual(std::string str1, std::string str2);
+u64 hash64(std::span<const u8> data, u64 seed = 0);
 u32 roundUp(u32 x, u32 powerOf2);
 s32 readFile(std::vector<u8>& contents, const fs::path& filename);
-void writeFile(const fs::path& filename, const std::vector<u8>& contents);
-void writeFile(const fs::path& filename, const std::string& contents);
+result_t writeFile(const fs::path& filename, std::span<const u8> contents);
+result_t writeFile(const fs::path& filename, const std::string& contents);
+
+// read-only view of a whole file. large files are memory-mapped so readers can parse them in
+// place, and small ones are read into memory with a single read since mapping costs more than
+// copying them
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	result_t open(const fs::path& filename);
+	void close();
+
+	std::span<const u8> getData() const { return { mData, mSize }; }
+
+	size_t getSize() const { return mSize; }
+
+	bool isMapped() const { return mIsMapped; }
+
+private:
+	const u8* mData = nullptr;
+	size_t mSize = 0;
+	bool mIsMapped = false;
+	std::vector<u8> mBuffer;
+};
 
 template <class T>
 inline void hashCombine(size_t& s, const T& v) {
@@ -44,43 +96,211 @@ inline void hashCombine(size_t& s, const T& v) {
 namespace reader {
 u8 readU8(const u8* offset);
 s8 readS8(const u8* offset);
-u16 readU16(const u8* offset, util::ByteOrder byteOrder);
-s16 readS16(const u8* offset, util::ByteOrder byteOrder);
-f16 readF16(const u8* offset, util::ByteOrder byteOrder);
-u32 readU24(const u8* offset, util::ByteOrder byteOrder);
-u32 readU32(const u8* offset, util::ByteOrder byteOrder);
-s32 readS32(const u8* offset, util::ByteOrder byteOrder);
-f32 readF32(const u8* offset, util::ByteOrder byteOrder);
-u64 readU64(const u8* offset, util::ByteOrder byteOrder);
-s64 readS64(const u8* offset, util::ByteOrder byteOrder);
-f64 readF64(const u8* offset, util::ByteOrder byteOrder);
-
-u16 readU16BE(const u8* offset);
-u16 readU16LE(const u8* offset);
-s16 readS16BE(const u8* offset);
-s16 readS16LE(const u8* offset);
-f16 readF16BE(const u8* offset);
-f16 readF16LE(const u8* offset);
-u32 readU24BE(const u8* offset);
-u32 readU24LE(const u8* offset);
-u32 readU32BE(const u8* offset);
-u32 readU32LE(const u8* offset);
-s32 readS32BE(const u8* offset);
-s32 readS32LE(const u8* offset);
-f32 readF32BE(const u8* offset);
-f32 readF32LE(const u8* offset);
-u64 readU64BE(const u8* offset);
-u64 readU64LE(const u8* offset);
-s64 readS64BE(const u8* offset);
-s64 readS64LE(const u8* offset);
-f64 readF64BE(const u8* offset);
-f64 readF64LE(const u8* offset);
+
+// reads values in a byte order fixed at compile time, as one load plus a byte swap when the order
+// isn't the host's. parsers pick the specialization once with `dispatchEndian` instead of checking
+// the byte order on every read
+template <util::ByteOrder Order>
+struct Endian {
+	static constexpr bool NEEDS_SWAP = util::needsSwap(Order);
+
+	template <typename T>
+	static T read(const u8* offset) {
+		using U = std::conditional_t<
+			sizeof(T) == 2, u16, std::conditional_t<sizeof(T) == 4, u32, u64>>;
+
+		U raw;
+		std::memcpy(&raw, offset, sizeof(U));
+		if constexpr (NEEDS_SWAP) raw = util::byteswap(raw);
+		return std::bit_cast<T>(raw);
+	}
+
+	static u32 readU24(const u8* offset) {
+		if constexpr (Order == util::ByteOrder::Big)
+			return (offset[0] << 16) | (offset[1] << 8) | offset[2];
+		else
+			return offset[0] | (offset[1] << 8) | (offset[2] << 16);
+	}
+
+	static u16 readU16(const u8* offset) { return read<u16>(offset); }
+
+	static s16 readS16(const u8* offset) { return read<s16>(offset); }
+
+	static f16 readF16(const u8* offset) { return read<f16>(offset); }
+
+	static u32 readU32(const u8* offset) { return read<u32>(offset); }
+
+	static s32 readS32(const u8* offset) { return read<s32>(offset); }
+
+	static f32 readF32(const u8* offset) { return read<f32>(offset); }
+
+	static u64 readU64(const u8* offset) { return read<u64>(offset); }
+
+	static s64 readS64(const u8* offset) { return read<s64>(offset); }
+
+	static f64 readF64(const u8* offset) { return read<f64>(offset); }
+};
+
+using BigEndian = Endian<util::ByteOrder::Big>;
+using LittleEndian = Endian<util::ByteOrder::Little>;
+
+// calls `func` with a `BigEndian` or `LittleEndian` argument, so that everything it reads through
+// that type is compiled for a single byte order
+template <typename Func>
+inline decltype(auto) dispatchEndian(util::ByteOrder byteOrder, Func&& func) {
+	if (byteOrder == util::ByteOrder::Big) return func(BigEndian());
+	return func(LittleEndian());
+}
+
+inline u16 readU16(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readU16(offset);
+	return LittleEndian::readU16(offset);
+}
+
+inline s16 readS16(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readS16(offset);
+	return LittleEndian::readS16(offset);
+}
+
+inline f16 readF16(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readF16(offset);
+	return LittleEndian::readF16(offset);
+}
+
+inline u32 readU24(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readU24(offset);
+	return LittleEndian::readU24(offset);
+}
+
+inline u32 readU32(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readU32(offset);
+	return LittleEndian::readU32(offset);
+}
+
+inline s32 readS32(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readS32(offset);
+	return LittleEndian::readS32(offset);
+}
+
+inline f32 readF32(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readF32(offset);
+	return LittleEndian::readF32(offset);
+}
+
+inline u64 readU64(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readU64(offset);
+	return LittleEndian::readU64(offset);
+}
+
+inline s64 readS64(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readS64(offset);
+	return LittleEndian::readS64(offset);
+}
+
+inline f64 readF64(const u8* offset, util::ByteOrder byteOrder) {
+	if (byteOrder == util::ByteOrder::Big) return BigEndian::readF64(offset);
+	return LittleEndian::readF64(offset);
+}
+
+inline u16 readU16BE(const u8* offset) {
+	return BigEndian::readU16(offset);
+}
+
+inline u16 readU16LE(const u8* offset) {
+	return LittleEndian::readU16(offset);
+}
+
+inline s16 readS16BE(const u8* offset) {
+	return BigEndian::readS16(offset);
+}
+
+inline s16 readS16LE(const u8* offset) {
+	return LittleEndian::readS16(offset);
+}
+
+inline f16 readF16BE(const u8* offset) {
+	return BigEndian::readF16(offset);
+}
+
+inline f16 readF16LE(const u8* offset) {
+	return LittleEndian::readF16(offset);
+}
+
+inline u32 readU24BE(const u8* offset) {
+	return BigEndian::readU24(offset);
+}
+
+inline u32 readU24LE(const u8* offset) {
+	return LittleEndian::readU24(offset);
+}
+
+inline u32 readU32BE(const u8* offset) {
+	return BigEndian::readU32(offset);
+}
+
+inline u32 readU32LE(const u8* offset) {
+	return LittleEndian::readU32(offset);
+}
+
+inline s32 readS32BE(const u8* offset) {
+	return BigEndian::readS32(offset);
+}
+
+inline s32 readS32LE(const u8* offset) {
+	return LittleEndian::readS32(offset);
+}
+
+inline f32 readF32BE(const u8* offset) {
+	return BigEndian::readF32(offset);
+}
+
+inline f32 readF32LE(const u8* offset) {
+	return LittleEndian::readF32(offset);
+}
+
+inline u64 readU64BE(const u8* offset) {
+	return BigEndian::readU64(offset);
+}
+
+inline u64 readU64LE(const u8* offset) {
+	return LittleEndian::readU64(offset);
+}
+
+inline s64 readS64BE(const u8* offset) {
+	return BigEndian::readS64(offset);
+}
+
+inline s64 readS64LE(const u8* offset) {
+	return LittleEndian::readS64(offset);
+}
+
+inline f64 readF64BE(const u8* offset) {
+	return BigEndian::readF64(offset);
+}
+
+inline f64 readF64LE(const u8* offset) {
+	return LittleEndian::readF64(offset);
+}
 
 result_t readByteOrder(util::ByteOrder* out, const u8* offset, u16 expectedBE);
 result_t checkSignature(const u8* offset, const std::string& expected, size_t length);
 const std::string readString(const u8* offset);
 const std::string readString(const u8* offset, size_t length);
 std::vector<u8> readBytes(const u8* offset, size_t size);
+
+// reads `out.size()` consecutive values in the given byte order
+template <typename T>
+void readArray(std::span<T> out, const u8* src, util::ByteOrder byteOrder) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+
+	if (out.empty()) return;
+
+	if (sizeof(T) > 1 && util::needsSwap(byteOrder))
+		util::byteswapArray(out.data(), src, out.size(), sizeof(T));
+	else
+		std::memcpy(out.data(), src, out.size_bytes());
+}
 } // namespace reader
 
 namespace writer {
@@ -114,5 +334,22 @@ void writeF64LE(std::vector<u8>& buffer, size_t offset, f64 value);
 void writeString(
 	std::vector<u8>& buffer, size_t offset, const std::string& str, bool isNullTerminated = true
 );
-void writeBytes(std::vector<u8>& buffer, size_t offset, const std::vector<u8>& bytes);
+void writeBytes(std::vector<u8>& buffer, size_t offset, std::span<const u8> bytes);
+
+// writes `values` consecutively in the given byte order
+template <typename T>
+void writeArray(
+	std::vector<u8>& buffer, size_t offset, std::span<const T> values, util::ByteOrder byteOrder
+) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+
+	if (values.empty()) return;
+	if (offset + values.size_bytes() > buffer.size()) buffer.resize(offset + values.size_bytes());
+
+	if (sizeof(T) > 1 && util::needsSwap(byteOrder))
+		util::byteswapArray(&buffer[offset], values.data(), values.size(), sizeof(T));
+	else
+		std::memcpy(&buffer[offset], values.data(), values.size_bytes());
+}
 } // namespace writer
@@ -3,11 +3,185 @@
 // Yaz0 compression file format
 // credit to http://amnoid.de/gc/yaz0.txt for helping me understand the format
 
+#include <array>
+#include <span>
 #include <vector>
 
 #include "afl/types.h"
+#include "afl/util.h"
 
 namespace yaz0 {
+
+enum Error : result_t {
+	InvalidOffset = 0x201,
+	Truncated = 0x202,
+	OutputTooSmall = 0x203,
+	OutOfRange = 0x204,
+	IndexMismatch = 0x205,
+	InvalidIndex = 0x206,
+};
+
+enum class Level {
+	Fast,   // one match candidate per position, for quick iteration
+	Normal, // greedy search of the most recent candidates
+	Max,    // optimal parse over every candidate, for the smallest output
+};
+
+// reads the uncompressed size from the header, e.g. to allocate a destination for `decompress`
+result_t getUncompressedSize(u32* out, std::span<const u8> input);
+// decompresses into a buffer owned by the caller, which must hold at least the uncompressed size
+result_t decompress(std::span<u8> output, std::span<const u8> input);
 s32 decompress(std::vector<u8>& output, const std::vector<u8>& input);
-void compress(std::vector<u8>& output, const std::vector<u8>& input, u32 alignment);
+// decompresses only the first `output.size()` bytes, or the whole file if it's smaller
+result_t decompressPrefix(std::span<u8> output, std::span<const u8> input);
+// resumable version of `decompressPrefix` for output which is decoded as it's needed. `output`
+// must hold the whole file, and `source` and `dest` (both 0 at first) hold where the previous call
+// stopped in the input and output. decoding stops at the first group of tokens ending at or after
+// `size`, so a few more bytes than that may be written
+result_t decompressPrefix(
+	std::span<u8> output, std::span<const u8> input, u32 size, size_t* source, u32* dest
+);
+// decompresses only the bytes in [offset, offset + output.size()). everything before the range
+// still has to be decoded, but only the last 4 KiB of it is kept
+result_t decompressRange(std::span<u8> output, std::span<const u8> input, u32 offset);
+void compress(
+	std::vector<u8>& output, const std::vector<u8>& input, u32 alignment,
+	Level level = Level::Normal
+);
+
+// splits the input into segments which are compressed on separate threads and then joined into
+// a single stream. a `threadCount` of 0 uses every available core
+void compressParallel(
+	std::vector<u8>& output, const std::vector<u8>& input, u32 alignment,
+	Level level = Level::Normal, u32 threadCount = 0
+);
+
+// compresses or decompresses many independent buffers on a pool of `threadCount` threads (0 for
+// every core), with outputs in the same order as the inputs. large inputs to `compressBatch` are
+// split up like in `compressParallel`, so that one of them doesn't keep the other threads idle
+void compressBatch(
+	std::vector<std::vector<u8>>& outputs, const std::vector<std::vector<u8>>& inputs,
+	u32 alignment, Level level = Level::Normal, u32 threadCount = 0
+);
+// returns the first error in input order, if any
+result_t decompressBatch(
+	std::vector<std::vector<u8>>& outputs, const std::vector<std::vector<u8>>& inputs,
+	u32 threadCount = 0
+);
+
+// decompresses a stream incrementally from chunks of input into chunks of output, keeping only
+// the last 4 KiB of output as history
+class Decoder {
+public:
+	// decodes as much of `input` as fits in `output`, and stores how many bytes of each were used
+	// in `consumed` and `produced`. any input which isn't consumed must be passed in again
+	result_t decode(
+		size_t* consumed, size_t* produced, std::span<const u8> input, std::span<u8> output
+	);
+
+	bool isHeaderRead() const { return mHeaderSize == HEADER_SIZE; }
+
+	bool isFinished() const { return isHeaderRead() && mOutputPos == mUncompressedSize; }
+
+	u32 getUncompressedSize() const { return mUncompressedSize; }
+
+	u32 getAlignment() const { return mAlignment; }
+
+	u32 getOutputPos() const { return mOutputPos; }
+
+private:
+	static constexpr u32 HEADER_SIZE = 0x10;
+	static constexpr u32 WINDOW_SIZE = 0x1000;
+
+	result_t readHeader();
+
+	std::array<u8, HEADER_SIZE> mHeader;
+	u32 mHeaderSize = 0;
+	u32 mUncompressedSize = 0;
+	u32 mAlignment = 0;
+
+	u8 mCodeByte = 0;
+	u32 mBitsLeft = 0;
+	// bytes of a back-reference which is split across input chunks
+	std::array<u8, 3> mToken;
+	u32 mTokenSize = 0;
+	// back-reference which is split across output chunks
+	u32 mCopyCount = 0;
+	u32 mCopyDistance = 0;
+
+	std::array<u8, WINDOW_SIZE> mWindow;
+	u32 mOutputPos = 0;
+};
+
+
+// checkpoints recorded while decoding a stream once, so that later reads of a range of its output
+// can resume from the nearest checkpoint instead of from the start. each checkpoint is placed at
+// the start of a group of tokens at least `interval` bytes of output after the previous one (and
+// no less than 4 KiB), and holds the last 4 KiB of output before it as history
+//
+// saved layout (little endian):
+//   0x00  char[4]  signature "YIDX"
+//   0x04  u32      compressed size
+//   0x08  u32      uncompressed size
+//   0x0c  u32      checkpoint interval
+//   0x10  u32      checkpoint count
+//   0x14  checkpoints: u32 input offset, u32 output offset, then min(output offset, 0x1000)
+//         bytes of history
+class SeekIndex {
+public:
+	result_t build(std::span<const u8> input, u32 interval = 0x10000);
+	result_t load(std::span<const u8> data);
+	void save(std::vector<u8>& out) const;
+
+	// same as `yaz0::decompressRange`, but `input` must be the stream the index was built from
+	result_t decompressRange(std::span<u8> output, std::span<const u8> input, u32 offset) const;
+
+	size_t getCheckpointCount() const { return mCheckpoints.size(); }
+
+private:
+	static constexpr u32 WINDOW_SIZE = 0x1000;
+
+	struct Checkpoint {
+		u32 mInputOffset;
+		u32 mOutputOffset;
+		u32 mWindowOffset;
+	};
+
+	u32 mCompressedSize = 0;
+	u32 mUncompressedSize = 0;
+	u32 mInterval = 0;
+	std::vector<Checkpoint> mCheckpoints;
+	// history of every checkpoint, back to back
+	std::vector<u8> mWindows;
+};
+
+
+// on-disk cache of compressed output, keyed by a hash of the input, alignment and level. when
+// the files in `dir` add up to more than `maxSize` bytes, the least recently used ones are removed.
+// each entry is followed by a trailer of the u64 size and u64 `util::hash64` of the compressed
+// data (little endian), and entries which don't match their trailer are compressed again.
+// temporary files from writes in progress count towards `maxSize` as well, and ones which are
+// more than an hour old are removed
+class Cache {
+public:
+	Cache(const fs::path& dir, u64 maxSize) : mDir(dir), mMaxSize(maxSize) {}
+
+	// same as `yaz0::compress`, but reads the output from the cache if the same input has been
+	// compressed before, and stores it otherwise
+	void compress(
+		std::vector<u8>& output, const std::vector<u8>& input, u32 alignment,
+		Level level = Level::Normal
+	);
+
+private:
+	static constexpr u32 TRAILER_SIZE = 0x10;
+
+	bool read(std::vector<u8>& output, const fs::path& path, u32 uncompressedSize, u32 alignment);
+	void write(const fs::path& path, const std::vector<u8>& output);
+	void evict();
+
+	const fs::path mDir;
+	const u64 mMaxSize;
+};
+
 } // namespace yaz0
@@ -189,10 +189,9 @@ result_t BFFNT::read() {
 	r = readTGLP(&mContents[0] + mFontInfo.mTGLPOffset - 8);
 	if (r) return r;
 
-	const u8* imageOffset = &mContents[0] + mTexGlyph.mImageDataOffset;
-	std::vector<u8> imageData = reader::readBytes(imageOffset, mTexGlyph.mPerTexSize);
-
-	util::writeFile("out.bntx", imageData);
+	util::writeFile(
+		"out.bntx", mContents.subspan(mTexGlyph.mImageDataOffset, mTexGlyph.mPerTexSize)
+	);
 
 	// character width table
 	const u8* nextOffset = &mContents[0] + mFontInfo.mCWDHOffset;
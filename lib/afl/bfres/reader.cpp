@@ -1,4 +1,7 @@
 #include "afl/bfres.h"
+
+#include <algorithm>
+
 #include "tinygltf/tiny_gltf.h"
 
 namespace bfres {
@@ -290,19 +293,29 @@ result_t Reader::exportGLTF(const fs::path& output) {
 			bufferView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
 			m.bufferViews.push_back(bufferView);
 
-			buffer.data.reserve(buffer.data.size() + bufLen);
-			for (u32 v = 0; v < buf->mCount; v++) {
-				const u8* vtxOffset = buf->mOffset + v * buf->mStride;
-				Vector4f data;
-				r = readAttrFormat(&data, vtxOffset, attr->mFormat, mByteOrder);
-				if (r) return r;
-
-				writer::writeF32(buffer.data, curOffset, data.x, mByteOrder);
-				if (size > 1) writer::writeF32(buffer.data, curOffset + 4, data.y, mByteOrder);
-				if (size > 2) writer::writeF32(buffer.data, curOffset + 8, data.z, mByteOrder);
-				if (size > 3) writer::writeF32(buffer.data, curOffset + 12, data.w, mByteOrder);
-				curOffset += size * 4;
+			// float attributes in a buffer of their own are already laid out like the output, so
+			// they're converted in one go. everything else is decoded vertex by vertex
+			std::vector<f32> values(buf->mCount * size);
+			bool isSingle = attr->mFormat == AttributeFormat::Format_32_Single ||
+			                attr->mFormat == AttributeFormat::Format_32_32_Single ||
+			                attr->mFormat == AttributeFormat::Format_32_32_32_Single ||
+			                attr->mFormat == AttributeFormat::Format_32_32_32_32_Single;
+			if (isSingle && buf->mStride == size * 4) {
+				reader::readArray(std::span<f32>(values), buf->mOffset, mByteOrder);
+			} else {
+				for (u32 v = 0; v < buf->mCount; v++) {
+					const u8* vtxOffset = buf->mOffset + v * buf->mStride;
+					Vector4f data;
+					r = readAttrFormat(&data, vtxOffset, attr->mFormat, mByteOrder);
+					if (r) return r;
+
+					const f32 components[4] = { data.x, data.y, data.z, data.w };
+					std::copy_n(components, size, &values[v * size]);
+				}
 			}
+
+			writer::writeArray(buffer.data, curOffset, std::span<const f32>(values), mByteOrder);
+			curOffset += bufLen;
 		}
 
 		modelNode.children.push_back(m.nodes.size());
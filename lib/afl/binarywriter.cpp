@@ -0,0 +1,50 @@
+#include "afl/binarywriter.h"
+
+namespace util {
+
+BinaryWriter::BinaryWriter(std::vector<u8>& buffer, ByteOrder byteOrder, size_t capacity) :
+	mBuffer(buffer), mByteOrder(byteOrder),
+	mNeedsSwap(needsSwap(byteOrder)) {
+	mBuffer.clear();
+	mBuffer.reserve(capacity);
+}
+
+void BinaryWriter::writeU24(u32 value) {
+	u8* ptr = grow(3);
+	if (mByteOrder == ByteOrder::Big) {
+		ptr[0] = value >> 16;
+		ptr[1] = value >> 8;
+		ptr[2] = value;
+	} else {
+		ptr[0] = value;
+		ptr[1] = value >> 8;
+		ptr[2] = value >> 16;
+	}
+}
+
+void BinaryWriter::writeString(std::string_view str, bool isNullTerminated) {
+	u8* ptr = grow(str.size() + isNullTerminated);
+	std::memcpy(ptr, str.data(), str.size());
+	if (isNullTerminated) ptr[str.size()] = 0;
+}
+
+void BinaryWriter::writeBytes(std::span<const u8> bytes) {
+	if (bytes.empty()) return;
+
+	std::memcpy(grow(bytes.size()), bytes.data(), bytes.size());
+}
+
+BinaryWriter::Slot BinaryWriter::reserveU32() {
+	Slot slot = { mPos };
+	writeU32(0);
+	return slot;
+}
+
+void BinaryWriter::patchU32(Slot slot, u32 value) {
+	size_t pos = mPos;
+	mPos = slot.mOffset;
+	writeU32(value);
+	mPos = pos;
+}
+
+} // namespace util
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 #include <numeric>
 
 namespace byml {
@@ -49,6 +50,10 @@ result_t Reader::init(const u8* fileData) {
 	return 0;
 }
 
+result_t Reader::init(std::span<const u8> fileData) {
+	return init(fileData.data());
+}
+
 result_t Reader::init(const Reader& other, const u32 offset) {
 	result_t r;
 
@@ -64,19 +69,21 @@ result_t Reader::init(const Reader& other, const u32 offset) {
 void Reader::initKeyOrder() {
 	if (getType() != NodeType::Hash) return;
 
+	const u32 size = getSize();
 	std::vector<u32> offsets;
-	offsets.reserve(getSize());
-	for (u32 i = 0; i < getSize(); i++) {
-		NodeType type = (NodeType)reader::readU8(mOffset + 4 + i * 8 + 3);
-		if (type == NodeType::Array || type == NodeType::Hash) {
-			u32 offset = reader::readU32(mOffset + 8 + i * 8, mHeader.mByteOrder);
-			offsets.push_back(offset);
-		} else {
-			offsets.push_back(0xffffffff);
+	offsets.reserve(size);
+	reader::dispatchEndian(mHeader.mByteOrder, [&](auto endian) {
+		using Endian = decltype(endian);
+		for (u32 i = 0; i < size; i++) {
+			NodeType type = (NodeType)reader::readU8(mOffset + 4 + i * 8 + 3);
+			if (type == NodeType::Array || type == NodeType::Hash)
+				offsets.push_back(Endian::readU32(mOffset + 8 + i * 8));
+			else
+				offsets.push_back(0xffffffff);
 		}
-	}
+	});
 
-	mKeyOrder.resize(getSize());
+	mKeyOrder.resize(size);
 	std::iota(mKeyOrder.begin(), mKeyOrder.end(), 0);
 
 	std::stable_sort(mKeyOrder.begin(), mKeyOrder.end(), [&offsets](size_t i1, size_t i2) {
@@ -113,14 +120,7 @@ const std::string Reader::getValueString(u32 idx) const {
 bool Reader::hasKey(const std::string& key) const {
 	if (getType() != NodeType::Hash) return false;
 
-	// TODO: implement binary search
-	for (u32 i = 0; i < getSize(); i++) {
-		const u8* childOffset = mOffset + 4 + i * 8;
-		u32 keyIdx = reader::readU24(childOffset, mHeader.mByteOrder);
-		if (util::isEqual(key, getHashString(keyIdx))) return true;
-	}
-
-	return false;
+	return findChild(key) != nullptr;
 }
 
 bool Reader::isExistHashString(const std::string& str) const {
@@ -139,6 +139,28 @@ bool Reader::isExistStringValue(const std::string& str) const {
 	return false;
 }
 
+// returns the entry of this hash node with the given key, or nullptr if there isn't one. compares
+// the key against the string table in place instead of copying out every key
+const u8* Reader::findChild(const std::string& key) const {
+	const u32 size = getSize();
+	const u8* keyTable = mFileData + mHeader.mHashKeyTableOffset;
+
+	return reader::dispatchEndian(mHeader.mByteOrder, [&](auto endian) -> const u8* {
+		using Endian = decltype(endian);
+		// TODO: implement binary search
+		for (u32 i = 0; i < size; i++) {
+			const u8* childOffset = mOffset + 4 + i * 8;
+			u32 keyIdx = Endian::readU24(childOffset);
+			if (keyIdx >= mHeader.mHashKeyTableSize) continue;
+
+			const char* str = (const char*)keyTable + Endian::readU32(keyTable + 4 + keyIdx * 4);
+			if (std::strcmp(key.c_str(), str) == 0) return childOffset;
+		}
+
+		return nullptr;
+	});
+}
+
 result_t Reader::getContainerOffsets(const u8** typeOffset, const u8** valueOffset, u32 idx) const {
 	if (getType() == NodeType::Array) {
 		*typeOffset = mOffset + 4 + idx;
@@ -285,38 +307,25 @@ result_t Reader::getU64ByIdx(u64* out, u32 idx) const {
 result_t Reader::getTypeByKey(NodeType* type, const std::string& key) const {
 	if (getType() != NodeType::Hash) return Error::WrongNodeType;
 
-	// TODO: implement binary search
-	for (u32 i = 0; i < getSize(); i++) {
-		const u8* childOffset = mOffset + 4 + i * 8;
-		u32 keyIdx = reader::readU24(childOffset, mHeader.mByteOrder);
-		if (util::isEqual(key, getHashString(keyIdx))) {
-			*type = (NodeType)reader::readU8(childOffset + 3);
-			return 0;
-		}
-	}
+	const u8* childOffset = findChild(key);
+	if (!childOffset) return Error::InvalidKey;
 
-	return Error::InvalidKey;
+	*type = (NodeType)reader::readU8(childOffset + 3);
+	return 0;
 }
 
 result_t Reader::getContainerByKey(Reader* container, const std::string& key) const {
 	if (getType() != NodeType::Hash) return Error::WrongNodeType;
 
-	// TODO: implement binary search
-	for (u32 i = 0; i < getSize(); i++) {
-		const u8* childOffset = mOffset + 4 + i * 8;
-		u32 keyIdx = reader::readU24(childOffset, mHeader.mByteOrder);
-		if (util::isEqual(key, getHashString(keyIdx))) {
-			NodeType type = (NodeType)reader::readU8(childOffset + 3);
-			if (type != NodeType::Array && type != NodeType::Hash) return Error::WrongNodeType;
-
-			u32 value = reader::readU32(childOffset + 4, mHeader.mByteOrder);
-			container->init(*this, value);
+	const u8* childOffset = findChild(key);
+	if (!childOffset) return Error::InvalidKey;
 
-			return 0;
-		}
-	}
+	NodeType type = (NodeType)reader::readU8(childOffset + 3);
+	if (type != NodeType::Array && type != NodeType::Hash) return Error::WrongNodeType;
 
-	return Error::InvalidKey;
+	u32 value = reader::readU32(childOffset + 4, mHeader.mByteOrder);
+	container->init(*this, value);
+	return 0;
 }
 
 result_t Reader::getNodeByKey(
@@ -324,20 +333,14 @@ result_t Reader::getNodeByKey(
 ) const {
 	if (getType() != NodeType::Hash) return Error::WrongNodeType;
 
-	// TODO: implement binary search
-	for (u32 i = 0; i < getSize(); i++) {
-		const u8* childOffset = mOffset + 4 + i * 8;
-		u32 keyIdx = reader::readU24(childOffset, mHeader.mByteOrder);
-		if (util::isEqual(key, getHashString(keyIdx))) {
-			NodeType childType = (NodeType)reader::readU8(childOffset + 3);
-			if (childType != expectedType) return Error::WrongNodeType;
-
-			*offset = childOffset;
-			return 0;
-		}
-	}
+	const u8* childOffset = findChild(key);
+	if (!childOffset) return Error::InvalidKey;
 
-	return Error::InvalidKey;
+	NodeType childType = (NodeType)reader::readU8(childOffset + 3);
+	if (childType != expectedType) return Error::WrongNodeType;
+
+	*offset = childOffset;
+	return 0;
 }
 
 result_t Reader::getStringByKey(std::string* out, const std::string& key) const {
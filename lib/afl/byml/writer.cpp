@@ -6,41 +6,38 @@
 namespace byml {
 
 void Writer::saveToVec(std::vector<u8>& out, util::ByteOrder byteOrder) {
-	if (byteOrder != util::ByteOrder::Little) {
-		fprintf(stderr, "error: unimplemented big-endian byml writer\n");
-		return;
-	}
-
-	writer::writeU16LE(out, 0, 0x4259);   // byte order mark
-	writer::writeU16LE(out, 2, mVersion); // version
-
 	u32 hashKeyTableOffset = 0x10;
 	u32 valueStringTableOffset = hashKeyTableOffset + mHashKeyStringTable.calcSize();
 	u32 data64Offset = valueStringTableOffset + mValueStringTable.calcSize();
 	u32 rootOffset = util::roundUp(data64Offset + mData64.size() * 8, 4);
 
-	writer::writeU32LE(out, 0x4, mHashKeyStringTable.isEmpty() ? 0 : hashKeyTableOffset);
-	writer::writeU32LE(out, 0x8, mValueStringTable.isEmpty() ? 0 : valueStringTableOffset);
-	writer::writeU32LE(out, 0xc, mContainerList.empty() ? 0 : rootOffset);
-
-	mHashKeyStringTable.write(out, hashKeyTableOffset);
-	mValueStringTable.write(out, valueStringTableOffset);
-
-	u32 writePtr = data64Offset;
-	for (auto* node : mData64) {
-		node->setOffset(writePtr);
-		node->writeData64(out, writePtr);
-		writePtr += 8;
-	}
-
-	writePtr = rootOffset;
+	u32 writePtr = rootOffset;
 	for (Container* container : mContainerList) {
 		container->setOffset(writePtr);
 		writePtr += container->calcSize();
 	}
 
+	util::BinaryWriter writer(out, byteOrder, writePtr);
+
+	writer.writeU16(0x4259);   // byte order mark
+	writer.writeU16(mVersion); // version
+	writer.writeU32(mHashKeyStringTable.isEmpty() ? 0 : hashKeyTableOffset);
+	writer.writeU32(mValueStringTable.isEmpty() ? 0 : valueStringTableOffset);
+	writer.writeU32(mContainerList.empty() ? 0 : rootOffset);
+
+	mHashKeyStringTable.write(writer);
+	writer.seek(valueStringTableOffset);
+	mValueStringTable.write(writer);
+
+	writer.seek(data64Offset);
+	for (auto* node : mData64) {
+		node->setOffset(writer.tell());
+		node->writeData64(writer);
+	}
+
 	for (Container* container : mContainerList) {
-		container->writeContainer(out);
+		writer.seek(container->mOffset);
+		container->writeContainer(writer);
 	}
 }
 
@@ -259,22 +256,21 @@ void Writer::StringTable::addString(const std::string& string) {
 	mStrings.insert(string);
 }
 
-void Writer::StringTable::write(std::vector<u8>& outputBuffer, u32 offset) const {
+void Writer::StringTable::write(util::BinaryWriter& writer) const {
 	if (isEmpty()) return;
 
-	writer::writeU8(outputBuffer, offset, (u8)NodeType::StringTable);
-	writer::writeU24LE(outputBuffer, offset + 1, size());
+	writer.writeU8((u8)NodeType::StringTable);
+	writer.writeU24(size());
 
-	u32 addrOffset = offset + 4;
-	u32 strOffset = addrOffset + 4 * size() + 4;
+	u32 strOffset = 4 + 4 * size() + 4;
 	for (const std::string& string : mStrings) {
-		writer::writeU32LE(outputBuffer, addrOffset, strOffset - offset);
-		writer::writeString(outputBuffer, strOffset, string);
+		writer.writeU32(strOffset);
 		strOffset += string.size() + 1;
-		addrOffset += 4;
 	}
+	writer.writeU32(strOffset);
 
-	writer::writeU32LE(outputBuffer, offset + 4 + 4 * size(), strOffset - offset);
+	for (const std::string& string : mStrings)
+		writer.writeString(string);
 }
 
 u32 Writer::StringTable::find(const std::string& string) const {
@@ -289,24 +285,21 @@ u32 Writer::StringTable::find(const std::string& string) const {
 	return 0xffffff;
 }
 
-void Writer::Array::writeContainer(std::vector<u8>& outputBuffer) const {
-	writer::writeU8(outputBuffer, mOffset, (u8)mType);
-	writer::writeU24LE(outputBuffer, mOffset + 1, size());
+void Writer::Array::writeContainer(util::BinaryWriter& writer) const {
+	writer.writeU8((u8)mType);
+	writer.writeU24(size());
 
-	u32 typeOffset = mOffset + 4;
 	for (Node* node : mNodes)
-		writer::writeU8(outputBuffer, typeOffset++, (u8)node->mType);
+		writer.writeU8((u8)node->mType);
 
-	u32 valueOffset = mOffset + 4 + util::roundUp(size(), 4);
-	for (Node* node : mNodes) {
-		node->write(outputBuffer, valueOffset);
-		valueOffset += 4;
-	}
+	writer.align(4);
+	for (Node* node : mNodes)
+		node->write(writer);
 }
 
-void Writer::Hash::writeContainer(std::vector<u8>& outputBuffer) const {
-	writer::writeU8(outputBuffer, mOffset, (u8)mType);
-	writer::writeU24LE(outputBuffer, mOffset + 1, size());
+void Writer::Hash::writeContainer(util::BinaryWriter& writer) const {
+	writer.writeU8((u8)mType);
+	writer.writeU24(size());
 
 	std::vector<std::pair<u32, Node*>> idxNodes;
 	idxNodes.reserve(mNodes.size());
@@ -318,12 +311,10 @@ void Writer::Hash::writeContainer(std::vector<u8>& outputBuffer) const {
 		return i1.first < i2.first;
 	});
 
-	u32 nodeOffset = mOffset + 4;
 	for (const auto& [keyIdx, node] : idxNodes) {
-		writer::writeU24LE(outputBuffer, nodeOffset, keyIdx);
-		writer::writeU8(outputBuffer, nodeOffset + 3, (u8)node->mType);
-		node->write(outputBuffer, nodeOffset + 4);
-		nodeOffset += 8;
+		writer.writeU24(keyIdx);
+		writer.writeU8((u8)node->mType);
+		node->write(writer);
 	}
 }
 
@@ -0,0 +1,105 @@
+#include "afl/sarc/common.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace sarc {
+
+result_t readTables(Tables* out, std::span<const u8> contents) {
+	if (contents.size() < 0x14 + 0xc) return util::Error::FileError;
+
+	result_t r;
+	r = reader::checkSignature(&contents[0], "SARC", 4);
+	if (r) return r;
+
+	Header& header = out->mHeader;
+	r = reader::readByteOrder(&header.mByteOrder, &contents[6], 0xFEFF);
+	if (r) return r;
+
+	const util::ByteOrder byteOrder = header.mByteOrder;
+	if (reader::readU16(&contents[4], byteOrder) != 0x14) return util::Error::HeaderSizeMismatch;
+	header.mFileSize = reader::readU32(&contents[8], byteOrder);
+	header.mDataOffset = reader::readU32(&contents[0xc], byteOrder);
+	header.mVersion = reader::readU16(&contents[0x10], byteOrder);
+	assert(header.mVersion == 0x100);
+	// 2 padding bytes
+
+	const u8* sfat = &contents[0x14];
+	r = reader::checkSignature(sfat, "SFAT", 4);
+	if (r) return r;
+	if (reader::readU16(sfat + 4, byteOrder) != 0xc) return util::Error::HeaderSizeMismatch;
+	u16 nodeCount = reader::readU16(sfat + 6, byteOrder);
+	out->mHashKey = reader::readU32(sfat + 8, byteOrder);
+
+	const u32 sfntOffset = 0x14 + 0xc + 0x10 * nodeCount;
+	if (sfntOffset + 0x8 > header.mDataOffset || header.mDataOffset > contents.size())
+		return util::Error::FileError;
+
+	out->mFiles.resize(nodeCount);
+	out->mIsSorted = true;
+	for (u32 i = 0; i < nodeCount; i++) {
+		const u8* fileOffset = sfat + 0xc + 0x10 * i;
+		FileEntry& file = out->mFiles[i];
+		file.mHash = reader::readU32(fileOffset, byteOrder);
+		file.mAttrs = reader::readU32(fileOffset + 4, byteOrder);
+		file.mStartOffset = reader::readU32(fileOffset + 8, byteOrder);
+		file.mEndOffset = reader::readU32(fileOffset + 0xc, byteOrder);
+
+		if (file.mStartOffset > file.mEndOffset ||
+		    header.mDataOffset + (u64)file.mEndOffset > contents.size())
+			return util::Error::FileError;
+		if (i > 0 && file.mHash < out->mFiles[i - 1].mHash) out->mIsSorted = false;
+	}
+
+	const u8* sfnt = &contents[sfntOffset];
+	r = reader::checkSignature(sfnt, "SFNT", 4);
+	if (r) return r;
+	if (reader::readU16(sfnt + 4, byteOrder) != 0x8) return util::Error::HeaderSizeMismatch;
+
+	// names are read from the table when they're needed
+	out->mNameTableOffset = sfntOffset + 0x8;
+
+	return 0;
+}
+
+u32 calcHash(std::string_view name, u32 key) {
+	u32 hash = 0;
+	for (char c : name)
+		hash = hash * key + (u8)c;
+	return hash;
+}
+
+std::string_view getName(std::span<const u8> names, const FileEntry& file) {
+	if (!(file.mAttrs >> 24)) return {};
+
+	size_t offset = (file.mAttrs & 0xffffff) * 4;
+	if (offset >= names.size()) return {};
+
+	const char* name = reinterpret_cast<const char*>(&names[offset]);
+	const void* end = std::memchr(name, 0, names.size() - offset);
+	return { name, end ? static_cast<const char*>(end) - name : names.size() - offset };
+}
+
+const FileEntry* findFile(
+	std::span<const FileEntry> files, std::span<const u8> names, u32 hashKey,
+	std::string_view name, bool isSorted
+) {
+	if (!isSorted) {
+		for (const FileEntry& file : files)
+			if (getName(names, file) == name) return &file;
+		return nullptr;
+	}
+
+	u32 hash = calcHash(name, hashKey);
+	auto it = std::lower_bound(
+		files.begin(), files.end(), hash,
+		[](const FileEntry& file, u32 hash) { return file.mHash < hash; }
+	);
+	for (; it != files.end() && it->mHash == hash; ++it)
+		if (getName(names, *it) == name) return &*it;
+
+	return nullptr;
+}
+
+} // namespace sarc
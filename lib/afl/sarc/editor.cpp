@@ -0,0 +1,254 @@
+#include "afl/sarc/editor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace sarc {
+
+result_t Editor::init() {
+	Tables tables;
+	result_t r = readTables(&tables, mContents);
+	if (r) return r;
+
+	mByteOrder = tables.mHeader.mByteOrder;
+	mDataOffset = tables.mHeader.mDataOffset;
+	mHashKey = tables.mHashKey;
+	mFiles = std::move(tables.mFiles);
+
+	// lookups binary search by hash, and the entries are written back in this order
+	std::stable_sort(mFiles.begin(), mFiles.end(), [](const File& i1, const File& i2) {
+		return i1.mHash < i2.mHash;
+	});
+
+	// the start of the data is aligned like the entries, which matters if there aren't any
+	mAlignment = std::min(mDataOffset & -mDataOffset, MAX_ALIGNMENT);
+	for (const File& file : mFiles) {
+		std::string_view name = getName(file);
+		if (!name.empty())
+			mNamesSize = std::max<u32>(mNamesSize, (file.mAttrs & 0xffffff) * 4 + name.size() + 1);
+
+		if (file.mEndOffset != file.mStartOffset)
+			mAlignment = std::max(mAlignment, getAlignment(file));
+	}
+
+	// with an alignment below 4 the data can start right after the last name, and a name without
+	// a null terminator runs up to the data
+	mNamesSize = std::min(mNamesSize, mDataOffset - (getSFNTOffset() + 0x8));
+
+	return 0;
+}
+
+result_t Editor::replace(std::string_view filename, std::span<const u8> data) {
+	File* file = findFile(filename);
+	if (!file) return util::Error::FileNotFound;
+
+	return replaceAt(file - mFiles.data(), data);
+}
+
+result_t Editor::add(std::string_view filename, std::span<const u8> data) {
+	if (File* file = findFile(filename)) return replaceAt(file - mFiles.data(), data);
+
+	if (mFiles.size() >= 0xffff) return util::Error::FileError;
+
+	u32 hash = calcHash(filename, mHashKey);
+	auto [begin, end] = std::equal_range(
+		mFiles.begin(), mFiles.end(), File { hash, 0, 0, 0 },
+		[](const File& i1, const File& i2) { return i1.mHash < i2.mHash; }
+	);
+	u32 hashCount = end - begin + 1;
+	size_t idx = end - mFiles.begin();
+
+	// the tables grow by one SFAT entry and the name, which starts at a multiple of 4
+	const u32 nameOffset = util::roundUp(mNamesSize, 4);
+	const u32 namesSize = nameOffset + filename.size() + 1;
+	const u32 sfntOffset = getSFNTOffset();
+	reserveTables(sfntOffset + 0x10 + 0x8 + namesSize);
+
+	std::memmove(&mContents[sfntOffset + 0x10], &mContents[sfntOffset], 0x8 + mNamesSize);
+	u8* names = &mContents[sfntOffset + 0x10 + 0x8];
+	std::memset(names + mNamesSize, 0, nameOffset - mNamesSize);
+	std::memcpy(names + nameOffset, filename.data(), filename.size());
+	names[namesSize - 1] = 0;
+	mNamesSize = namesSize;
+
+	// the data goes after all the other data
+	u32 start = getEnd(mAlignment);
+	mContents.resize(mDataOffset + start + data.size());
+	if (!data.empty()) std::memcpy(&mContents[mDataOffset + start], data.data(), data.size());
+
+	u32 attrs = (hashCount << 24) | ((nameOffset >> 2) & 0xffffff);
+	mFiles.insert(mFiles.begin() + idx, { hash, attrs, start, u32(start + data.size()) });
+
+	writeTables();
+	return 0;
+}
+
+result_t Editor::remove(std::string_view filename) {
+	File* filePtr = findFile(filename);
+	if (!filePtr) return util::Error::FileNotFound;
+
+	const size_t idx = filePtr - mFiles.data();
+	const File file = *filePtr;
+	const u64 slotEnd = getSlotEnd(idx);
+	const bool isShared = slotEnd < std::max(file.mStartOffset, file.mEndOffset);
+
+	// clear the name, and move the name table over the removed SFAT entry
+	std::string_view name = getName(file);
+	std::memset(const_cast<char*>(name.data()), 0, name.size());
+
+	const u32 sfntOffset = getSFNTOffset();
+	std::memmove(&mContents[sfntOffset - 0x10], &mContents[sfntOffset], 0x8 + mNamesSize);
+	std::memset(&mContents[sfntOffset - 0x10 + 0x8 + mNamesSize], 0, 0x10);
+
+	// entries with the same hash are numbered in order
+	for (File& other : mFiles)
+		if (other.mHash == file.mHash && (other.mAttrs >> 24) > (file.mAttrs >> 24))
+			other.mAttrs -= 1 << 24;
+
+	mFiles.erase(mFiles.begin() + idx);
+
+	if (!isShared && file.mEndOffset != file.mStartOffset) {
+		if (slotEnd != std::numeric_limits<u64>::max()) {
+			u32 size = (slotEnd - file.mStartOffset) & ~(getMoveAlignment(slotEnd) - 1);
+			moveData(slotEnd, -s64(size));
+		} else {
+			// the data was last, but empty entries may still point past it
+			u32 end = file.mStartOffset;
+			for (const File& other : mFiles)
+				end = std::max({ end, other.mStartOffset, other.mEndOffset });
+			mContents.resize(mDataOffset + end);
+		}
+	}
+
+	writeTables();
+	return 0;
+}
+
+result_t Editor::replaceAt(size_t idx, std::span<const u8> data) {
+	File& file = mFiles[idx];
+	const u64 slotEnd = getSlotEnd(idx);
+	u32 start = file.mStartOffset;
+
+	if (slotEnd < std::max(file.mStartOffset, file.mEndOffset)) {
+		// other entries use this data, so the new data goes after all the other data
+		start = getEnd(file.mEndOffset != file.mStartOffset ? getAlignment(file) : mAlignment);
+	} else if (start + data.size() > slotEnd) {
+		// make the slot big enough by moving everything after it
+		u32 size = util::roundUp(start + data.size() - slotEnd, getMoveAlignment(slotEnd));
+		moveData(slotEnd, size);
+		file.mStartOffset = start;
+	} else if (start + data.size() < file.mEndOffset) {
+		std::memset(
+			&mContents[mDataOffset + start + data.size()], 0,
+			file.mEndOffset - start - data.size()
+		);
+	}
+
+	if (mDataOffset + start + data.size() > mContents.size())
+		mContents.resize(mDataOffset + start + data.size());
+
+	if (!data.empty()) std::memcpy(&mContents[mDataOffset + start], data.data(), data.size());
+	file.mStartOffset = start;
+	file.mEndOffset = start + data.size();
+
+	writeTables();
+	return 0;
+}
+
+u64 Editor::getSlotEnd(size_t idx) const {
+	const File& file = mFiles[idx];
+
+	u64 end = std::numeric_limits<u64>::max();
+	for (size_t i = 0; i < mFiles.size(); i++) {
+		const File& other = mFiles[i];
+		if (i == idx || other.mStartOffset == other.mEndOffset) continue;
+		if (other.mEndOffset > file.mStartOffset) end = std::min<u64>(end, other.mStartOffset);
+	}
+
+	return end;
+}
+
+u32 Editor::getAlignment(const File& file) const {
+	u32 offset = mDataOffset + file.mStartOffset;
+	return std::min(offset & -offset, MAX_ALIGNMENT);
+}
+
+u32 Editor::getMoveAlignment(u32 start) const {
+	u32 alignment = 1;
+	for (const File& file : mFiles)
+		if (file.mStartOffset >= start && file.mEndOffset != file.mStartOffset)
+			alignment = std::max(alignment, getAlignment(file));
+
+	return alignment;
+}
+
+u32 Editor::getEnd(u32 alignment) const {
+	return util::roundUp(mContents.size(), alignment) - mDataOffset;
+}
+
+void Editor::moveData(u32 start, s64 delta) {
+	size_t offset = mDataOffset + start;
+	size_t size = mContents.size();
+
+	if (delta > 0) {
+		mContents.resize(size + delta);
+		std::memmove(&mContents[offset + delta], &mContents[offset], size - offset);
+		std::memset(&mContents[offset], 0, delta);
+	} else {
+		std::memmove(&mContents[offset + delta], &mContents[offset], size - offset);
+		mContents.resize(size + delta);
+	}
+
+	for (File& file : mFiles) {
+		// empty entries can be left inside a slot that's being removed
+		if (delta < 0 && file.mStartOffset < start && file.mStartOffset >= start + delta) {
+			file.mStartOffset = start + delta;
+			file.mEndOffset = start + delta;
+			continue;
+		}
+		if (file.mStartOffset < start) continue;
+		file.mStartOffset += delta;
+		file.mEndOffset += delta;
+	}
+}
+
+void Editor::reserveTables(u32 end) {
+	if (end <= mDataOffset) return;
+
+	// the entries are relative to the start of the data, so only the header changes
+	u32 size = util::roundUp(end - mDataOffset, getMoveAlignment(0));
+	mContents.insert(mContents.begin() + mDataOffset, size, 0);
+	mDataOffset += size;
+}
+
+void Editor::writeTables() {
+	writer::writeU32(mContents, 0x8, mContents.size(), mByteOrder);
+	writer::writeU32(mContents, 0xc, mDataOffset, mByteOrder);
+	writer::writeU16(mContents, 0x14 + 6, mFiles.size(), mByteOrder);
+
+	for (size_t i = 0; i < mFiles.size(); i++) {
+		const File& file = mFiles[i];
+		size_t offset = 0x14 + 0xc + 0x10 * i;
+		writer::writeU32(mContents, offset, file.mHash, mByteOrder);
+		writer::writeU32(mContents, offset + 4, file.mAttrs, mByteOrder);
+		writer::writeU32(mContents, offset + 8, file.mStartOffset, mByteOrder);
+		writer::writeU32(mContents, offset + 0xc, file.mEndOffset, mByteOrder);
+	}
+}
+
+Editor::File* Editor::findFile(std::string_view name) {
+	const File* file = sarc::findFile(mFiles, getNames(), mHashKey, name);
+	return file ? &mFiles[file - mFiles.data()] : nullptr;
+}
+
+std::string_view Editor::getName(const File& file) const {
+	return sarc::getName(getNames(), file);
+}
+
+std::span<const u8> Editor::getNames() const {
+	const u32 offset = getSFNTOffset() + 0x8;
+	return std::span<const u8>(mContents).subspan(offset, mDataOffset - offset);
+}
+
+} // namespace sarc
@@ -1,151 +1,204 @@
 #include "afl/sarc/reader.h"
 
-#include <cassert>
+#include <atomic>
 #include <filesystem>
+#include <unordered_set>
+
+#include "afl/threadpool.h"
+
+#ifndef _WIN32
+# include <cerrno>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
 
 namespace sarc {
 
-result_t Reader::init() {
-	result_t r;
-	r = initHeader(&mContents[0]);
-	if (r) return r;
+namespace {
+
+// writes straight from `data` with one open and as few writes as possible
+result_t writeEntry(const fs::path& filename, std::span<const u8> data, bool preallocate) {
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return util::Error::FileError;
+
+# if defined(__linux__)
+	// unlike posix_fallocate, this fails instead of writing zeros where it isn't supported
+	if (preallocate && !data.empty()) fallocate(fd, 0, 0, data.size());
+# endif
+
+	for (size_t done = 0; done < data.size();) {
+		ssize_t count = ::write(fd, data.data() + done, data.size() - done);
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) {
+			::close(fd);
+			return util::Error::FileError;
+		}
+		done += count;
+	}
 
-	r = readSFAT(&mContents[0x14]);
-	if (r) return r;
+	return ::close(fd) == 0 ? 0 : util::Error::FileError;
+#else
+	return util::writeFile(filename, data);
+#endif
+}
 
-	r = readSFNT(&mContents[0x14 + 0xc + 0x10 * mFiles.size()]);
+} // namespace
+
+result_t Reader::init() {
+	Tables tables;
+	result_t r = readTables(&tables, mContents);
 	if (r) return r;
 
+	mHeader = tables.mHeader;
+	mHashKey = tables.mHashKey;
+	mIsSorted = tables.mIsSorted;
+	mNameTableOffset = tables.mNameTableOffset;
+	mFiles = std::move(tables.mFiles);
+
 	return 0;
 }
 
-result_t Reader::initHeader(const u8* offset) {
-	result_t r;
-	r = reader::checkSignature(offset, "SARC", 4);
-	if (r) return r;
+const std::set<std::string> Reader::getFilenames() {
+	std::set<std::string> filenames;
+	for (const File& file : mFiles)
+		filenames.emplace(getName(file));
 
-	u16 headerSize = reader::readU16(offset + 4, util::ByteOrder::Little);
-	r = reader::readByteOrder(&mHeader.mByteOrder, offset + 6, 0xFEFF);
-	if (r) return r;
+	return filenames;
+}
+
+result_t Reader::saveFile(const std::string& outDir, const std::string& filename) {
+	fs::path basePath(outDir);
+	std::error_code error;
+	fs::create_directory(basePath, error);
+	if (error) return util::Error::FileError;
 
-	mHeader.mFileSize = reader::readU32(offset + 8, mHeader.mByteOrder);
-	mHeader.mDataOffset = reader::readU32(offset + 0xc, mHeader.mByteOrder);
-	mHeader.mVersion = reader::readU16(offset + 0x10, mHeader.mByteOrder);
-	assert(mHeader.mVersion == 0x100);
-	// 2 padding bytes
+	const File* file = findFile(filename);
+	if (!file) return util::Error::FileNotFound;
 
-	return 0;
+	fs::path filePath = basePath / getName(*file);
+	fs::create_directories(filePath.parent_path(), error);
+	if (error) return util::Error::FileError;
+
+	return util::writeFile(filePath, getData(*file));
 }
 
-result_t Reader::readSFAT(const u8* offset) {
-	result_t r;
-	r = reader::checkSignature(offset, "SFAT", 4);
-	if (r) return r;
-	u16 headerSize = reader::readU16(offset + 4, mHeader.mByteOrder);
-	assert(headerSize == 0xc);
-	u16 nodeCount = reader::readU16(offset + 6, mHeader.mByteOrder);
-	u32 hashKey = reader::readU32(offset + 8, mHeader.mByteOrder);
-
-	mFiles.reserve(nodeCount);
-	for (s32 i = 0; i < nodeCount; i++) {
-		const u8* fileOffset = offset + 0xc + 0x10 * i;
-		File file;
-		file.mHash = reader::readU32(fileOffset, mHeader.mByteOrder);
-		file.mAttrs = reader::readU32(fileOffset + 4, mHeader.mByteOrder);
-		file.mStartOffset = reader::readU32(fileOffset + 8, mHeader.mByteOrder);
-		file.mEndOffset = reader::readU32(fileOffset + 0xc, mHeader.mByteOrder);
-		mFiles.push_back(file);
+result_t Reader::saveAll(const std::string& outDir, u32 threadCount, bool preallocate) {
+	fs::path basePath(outDir);
+
+	// every directory is created once up front, so the writers only create files
+	std::vector<Entry> entries;
+	std::unordered_set<std::string_view> dirs = { "" };
+	entries.reserve(mFiles.size());
+	for (Entry entry : *this) {
+		if (entry.mName.empty()) continue;
+
+		entries.push_back(entry);
+		size_t slash = entry.mName.rfind('/');
+		if (slash != std::string_view::npos) dirs.insert(entry.mName.substr(0, slash));
 	}
 
-	return 0;
-}
+	for (std::string_view dir : dirs) {
+		std::error_code error;
+		fs::create_directories(basePath / dir, error);
+		if (error) return util::Error::FileError;
+	}
 
-result_t Reader::readSFNT(const u8* offset) {
-	result_t r = reader::checkSignature(offset, "SFNT", 4);
-	if (r) return r;
-	u16 headerSize = reader::readU16(offset + 4, mHeader.mByteOrder);
-	assert(headerSize == 0x8);
-
-	const u8* nameTableOffset = offset + 8;
-	for (File& file : mFiles) {
-		if (file.mAttrs & (1 << 24)) {
-			u16 nameOffset = (file.mAttrs & 0xffff) * 4;
-			file.mName = reader::readString(nameTableOffset + nameOffset);
+	std::atomic<size_t> nextFile = 0;
+	std::atomic<result_t> result = 0;
+	auto writeFiles = [&] {
+		for (size_t i = nextFile++; i < entries.size(); i = nextFile++) {
+			result_t r = writeEntry(basePath / entries[i].mName, entries[i].mData, preallocate);
+			if (r) result = r;
 		}
+	};
+
+	if (threadCount == 1) {
+		writeFiles();
+	} else {
+		util::ThreadPool pool(threadCount);
+		for (u32 i = 0; i < pool.getThreadCount(); i++)
+			pool.submit(writeFiles);
+		pool.wait();
 	}
 
-	return 0;
+	return result;
 }
 
-const std::set<std::string> Reader::getFilenames() {
-	std::set<std::string> filenames;
-	for (const File& file : mFiles)
-		filenames.insert(file.mName);
+result_t Reader::getFileData(std::vector<u8>& out, const std::string& filename) {
+	const File* file = findFile(filename);
+	if (!file) return util::Error::FileNotFound;
 
-	return filenames;
+	std::span<const u8> data = getData(*file);
+	out.assign(data.begin(), data.end());
+	return 0;
 }
 
-result_t Reader::saveFile(const std::string& outDir, const std::string& filename) {
-	fs::path basePath(outDir);
-	fs::create_directory(basePath);
-
-	for (const File& file : mFiles) {
-		if (!util::isEqual(file.mName, filename)) continue;
+result_t Reader::getFileSize(u32* out, const std::string& filename) {
+	const File* file = findFile(filename);
+	if (!file) return util::Error::FileNotFound;
 
-		fs::path filePath = basePath / file.mName;
-		fs::create_directories(filePath.parent_path().c_str());
+	*out = file->mEndOffset - file->mStartOffset;
+	return 0;
+}
 
-		const u8* offset = &mContents[0] + mHeader.mDataOffset + file.mStartOffset;
-		u32 size = file.mEndOffset - file.mStartOffset;
-		std::vector<u8> contents = reader::readBytes(offset, size);
-		util::writeFile(basePath / file.mName, contents);
-		return 0;
-	}
+result_t Reader::getFileView(std::span<const u8>* out, const std::string& filename) const {
+	const File* file = findFile(filename);
+	if (!file) return util::Error::FileNotFound;
 
-	return util::Error::FileNotFound;
+	*out = getData(*file);
+	return 0;
 }
 
-result_t Reader::saveAll(const std::string& outDir) {
-	result_t r;
+result_t Reader::getFileViewByIndex(std::span<const u8>* out, u32 idx) const {
+	if (idx >= mFiles.size()) return util::Error::FileNotFound;
 
-	fs::path basePath(outDir);
-	fs::create_directory(basePath);
+	*out = getData(mFiles[idx]);
+	return 0;
+}
 
-	for (const File& file : mFiles) {
-		fs::path filePath = basePath / file.mName;
-		fs::create_directories(filePath.parent_path().c_str());
+result_t Reader::getFileAlignment(u32* out, const std::string& filename) const {
+	const File* file = findFile(filename);
+	if (!file) return util::Error::FileNotFound;
 
-		const u8* offset = &mContents[0] + mHeader.mDataOffset + file.mStartOffset;
-		u32 size = file.mEndOffset - file.mStartOffset;
-		std::vector<u8> contents = reader::readBytes(offset, size);
-		util::writeFile(filePath, contents);
-	}
+	*out = getAlignment(*file);
+	return 0;
+}
 
+result_t Reader::getFileAlignmentByIndex(u32* out, u32 idx) const {
+	if (idx >= mFiles.size()) return util::Error::FileNotFound;
+
+	*out = getAlignment(mFiles[idx]);
 	return 0;
 }
 
-result_t Reader::getFileData(std::vector<u8>& out, const std::string& filename) {
-	for (const File& file : mFiles) {
-		if (!util::isEqual(file.mName, filename)) continue;
+Reader::Entry Reader::getEntry(u32 idx) const {
+	const File& file = mFiles[idx];
+	return { getName(file), getData(file), file.mHash };
+}
 
-		const u8* offset = &mContents[0] + mHeader.mDataOffset + file.mStartOffset;
-		u32 size = file.mEndOffset - file.mStartOffset;
-		out = reader::readBytes(offset, size);
-		return 0;
-	}
+const Reader::File* Reader::findFile(std::string_view name) const {
+	return sarc::findFile(mFiles, getNames(), mHashKey, name, mIsSorted);
+}
 
-	return util::Error::FileNotFound;
+std::string_view Reader::getName(const File& file) const {
+	return sarc::getName(getNames(), file);
 }
 
-result_t Reader::getFileSize(u32* out, const std::string& filename) {
-	for (const File& file : mFiles) {
-		if (!util::isEqual(file.mName, filename)) continue;
+std::span<const u8> Reader::getNames() const {
+	return mContents.subspan(mNameTableOffset, mHeader.mDataOffset - mNameTableOffset);
+}
 
-		*out = file.mEndOffset - file.mStartOffset;
-		return 0;
-	}
+std::span<const u8> Reader::getData(const File& file) const {
+	return mContents.subspan(
+		mHeader.mDataOffset + file.mStartOffset, file.mEndOffset - file.mStartOffset
+	);
+}
 
-	return util::Error::FileNotFound;
+// SARC doesn't store alignments, so this is derived from where the data starts
+u32 Reader::getAlignment(const File& file) const {
+	u32 offset = mHeader.mDataOffset + file.mStartOffset;
+	return offset ? offset & -offset : 1u << 31;
 }
 
 } // namespace sarc
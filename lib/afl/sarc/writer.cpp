@@ -1,111 +1,330 @@
 #include "afl/sarc/writer.h"
 
 #include <algorithm>
+#include <limits>
 #include <span>
 #include <unordered_map>
 
+#include "afl/binarywriter.h"
+#include "afl/sarc/common.h"
 #include "afl/util.h"
 
+#ifndef _WIN32
+# include <cerrno>
+# include <climits>
+# include <fcntl.h>
+# include <sys/uio.h>
+# include <unistd.h>
+#endif
+
 namespace sarc {
 
-void Writer::saveToVec(std::vector<u8>& out, util::ByteOrder byteOrder, u32 alignment) {
-	if (byteOrder != util::ByteOrder::Little) {
-		fprintf(stderr, "error: unimplemented big-endian sarc writer\n");
-		return;
+#ifndef _WIN32
+namespace {
+
+// most systems allow 1024 buffers per writev call
+# ifdef IOV_MAX
+constexpr size_t IOV_BATCH = IOV_MAX < 1024 ? IOV_MAX : 1024;
+# else
+constexpr size_t IOV_BATCH = 16;
+# endif
+
+// writes all of `iov` and clears it, continuing after partial writes
+result_t writeVectors(int fd, std::vector<iovec>& iov) {
+	iovec* vec = iov.data();
+	size_t left = iov.size();
+
+	while (left > 0) {
+		ssize_t count = ::writev(fd, vec, left);
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) return util::Error::FileError;
+
+		for (; left > 0 && (size_t)count >= vec->iov_len; vec++, left--)
+			count -= vec->iov_len;
+
+		if (left > 0) {
+			vec->iov_base = (u8*)vec->iov_base + count;
+			vec->iov_len -= count;
+		}
 	}
 
-	const u32 sfatStart = 0x14;
-	const u32 sfatEntryStart = sfatStart + 0xc;
-	const u32 sfntStart = sfatEntryStart + 0x10 * mFiles.size();
-	const u32 sfntEntryStart = sfntStart + 0x8;
+	iov.clear();
+	return 0;
+}
 
-	u32 namesLen = 0;
-	u32 filesLen = 0;
+} // namespace
+#endif
+
+void Writer::sortFiles() {
+	std::stable_sort(mFiles.begin(), mFiles.end(), [this](const File& i1, const File& i2) {
+		return calcHash(i1.mName, mHashMultiplier) < calcHash(i2.mName, mHashMultiplier);
+	});
+}
+
+result_t Writer::loadPayloads(Payloads* payloads) const {
+	std::vector<size_t>& sizes = payloads->mSizes;
+	sizes.clear();
+	sizes.reserve(mFiles.size());
+
+	// files added by path are only opened once their data is needed
 	for (const File& file : mFiles) {
-		namesLen = util::roundUp(namesLen, 4) + file.mName.length() + 1;
-		filesLen = util::roundUp(filesLen, alignment) + file.mData.size();
+		u64 size = file.mView.empty() ? file.mData.size() : file.mView.size();
+		if (!file.mPath.empty()) {
+			std::error_code error;
+			size = fs::file_size(file.mPath, error);
+			if (error == std::errc::no_such_file_or_directory) return util::Error::FileNotFound;
+			if (error) return util::Error::FileError;
+		}
+
+		// the offsets in the table are only 32 bits
+		if (size > std::numeric_limits<u32>::max()) return util::Error::FileError;
+		sizes.push_back(size);
+	}
+
+	std::vector<u32>& sources = payloads->mSources;
+	sources.resize(sizes.size());
+	for (u32 i = 0; i < sizes.size(); i++)
+		sources[i] = i;
+
+	if (!mDeduplicate) return 0;
+
+	// only files which share their size with another file need to be hashed
+	std::unordered_map<size_t, u32> sizeCounts;
+	for (size_t size : sizes)
+		sizeCounts[size]++;
+
+	util::MappedFile mapping;
+	util::MappedFile otherMapping;
+	std::unordered_multimap<u64, u32> hashes;
+	for (u32 i = 0; i < sizes.size(); i++) {
+		if (sizeCounts[sizes[i]] < 2) continue;
+
+		std::span<const u8> data;
+		result_t r = openData(&data, *payloads, i, &mapping);
+		if (r) return r;
+
+		u64 hash = util::hash64(data);
+		auto [begin, end] = hashes.equal_range(hash);
+		for (auto it = begin; it != end; ++it) {
+			std::span<const u8> otherData;
+			r = openData(&otherData, *payloads, it->second, &otherMapping);
+			if (r) return r;
+
+			if (std::ranges::equal(otherData, data)) {
+				sources[i] = it->second;
+				break;
+			}
+		}
+
+		if (sources[i] == i) hashes.emplace(hash, i);
 	}
 
-	const u32 dataOffset = util::roundUp(sfntEntryStart + namesLen, alignment);
-	const u32 fileSize = dataOffset + filesLen;
+	return 0;
+}
+
+result_t Writer::openData(
+	std::span<const u8>* out, const Payloads& payloads, u32 idx, util::MappedFile* mapping
+) const {
+	const File& file = mFiles[idx];
+	if (file.mPath.empty()) {
+		*out = file.mView.empty() ? std::span<const u8>(file.mData) : file.mView;
+		return 0;
+	}
 
+	result_t r = mapping->open(file.mPath);
+	if (r) return r;
+
+	// the layout was made from the size the file had before
+	if (mapping->getSize() != payloads.mSizes[idx]) return util::Error::FileError;
+
+	*out = mapping->getData();
+	return 0;
+}
+
+u32 Writer::writeTables(util::BinaryWriter& writer, const Payloads& payloads, u32 alignment) const {
 	// file header
-	writer::writeString(out, 0x00, "SARC", false);
-	writer::writeU16LE(out, 0x04, 0x14);   // header size
-	writer::writeU16LE(out, 0x06, 0xfeff); // byte order mark
-	// writer::writeU32LE(out, 0x08, fileSize);
-	writer::writeU32LE(out, 0x0c, dataOffset);
-	writer::writeU16LE(out, 0x10, mVersion);
-	// 0x12 - 2 bytes padding
+	writer.writeString("SARC", false);
+	writer.writeU16(0x14);   // header size
+	writer.writeU16(0xfeff); // byte order mark
+	util::BinaryWriter::Slot fileSizeSlot = writer.reserveU32();
+	util::BinaryWriter::Slot dataOffsetSlot = writer.reserveU32();
+	writer.writeU16(mVersion);
+	writer.writeU16(0); // padding
 
 	// sfat header
-	writer::writeString(out, sfatStart + 0x00, "SFAT", false);
-	writer::writeU16LE(out, sfatStart + 0x04, 0xc); // header size
-	writer::writeU16LE(out, sfatStart + 0x06, mFiles.size());
-	writer::writeU32LE(out, sfatStart + 0x08, mHashMultiplier);
+	writer.writeString("SFAT", false);
+	writer.writeU16(0xc); // header size
+	writer.writeU16(mFiles.size());
+	writer.writeU32(mHashMultiplier);
 
-	// sfnt header
-	writer::writeString(out, sfntStart + 0x00, "SFNT", false);
-	writer::writeU16LE(out, sfntStart + 0x04, 0x8);
-	// 0x06 - 2 bytes padding
-
-	u32 sfatEntry = sfatEntryStart;
-	u32 sfntEntry = sfntEntryStart;
-	u32 dataEntry = dataOffset;
-	u32 dataEnd = dataOffset;
+	u32 nameEntry = 0;
+	u32 dataEntry = 0;
+	u32 dataEnd = 0;
 	std::unordered_map<u32, u8> hashes;
+	std::vector<u32> starts(mFiles.size());
 
-	std::stable_sort(mFiles.begin(), mFiles.end(), [this](const File& i1, const File& i2) {
-		return calcHash(i1.mName) < calcHash(i2.mName);
-	});
-
-	for (u32 i = 0; i < mFiles.size(); i++) {
+	for (size_t i = 0; i < mFiles.size(); i++) {
 		const File& file = mFiles[i];
+		u32 filenameHash = calcHash(file.mName, mHashMultiplier);
+		u8 hashCount = ++hashes[filenameHash];
+		u32 fileAttributes = (hashCount << 24) | ((nameEntry >> 2) & 0xffffff);
+		u32 size = payloads.mSizes[i];
 
-		u32 filenameHash = calcHash(file.mName);
-		if (hashes.contains(filenameHash)) {
-			hashes[filenameHash]++;
-		} else {
-			hashes[filenameHash] = 1;
+		// duplicates point at the data of the earlier file
+		u32 source = payloads.mSources[i];
+		if (source == i) {
+			starts[i] = dataEntry;
+			dataEnd = dataEntry + size;
+			dataEntry = util::roundUp(dataEnd, alignment);
 		}
-		u8 hashCount = hashes[filenameHash];
-		u32 fileAttributes = (hashCount << 24) | (((sfntEntry - sfntEntryStart) >> 2) & 0xffffff);
 
-		writer::writeU32LE(out, sfatEntry + 0x00, filenameHash);
-		writer::writeU32LE(out, sfatEntry + 0x04, fileAttributes);
-		writer::writeU32LE(out, sfatEntry + 0x08, dataEntry - dataOffset);
-		writer::writeU32LE(out, sfatEntry + 0x0c, dataEntry - dataOffset + file.mData.size());
+		writer.writeU32(filenameHash);
+		writer.writeU32(fileAttributes);
+		writer.writeU32(starts[source]);
+		writer.writeU32(starts[source] + size);
 
-		writer::writeString(out, sfntEntry, file.mName);
-		writer::writeBytes(out, dataEntry, file.mData);
+		nameEntry = util::roundUp(nameEntry + file.mName.length() + 1, 4);
+	}
+
+	// sfnt header
+	writer.writeString("SFNT", false);
+	writer.writeU16(0x8); // header size
+	writer.writeU16(0);   // padding
+
+	for (const File& file : mFiles) {
+		writer.align(4);
+		writer.writeString(file.mName);
+	}
+
+	writer.align(alignment);
+	writer.patchU32(dataOffsetSlot, writer.tell());
+	writer.patchU32(fileSizeSlot, writer.tell() + dataEnd);
+
+	return dataEnd;
+}
+
+result_t Writer::saveToVec(std::vector<u8>& out, util::ByteOrder byteOrder, u32 alignment) {
+	sortFiles();
+
+	Payloads payloads;
+	result_t r = loadPayloads(&payloads);
+	if (r) return r;
+
+	util::BinaryWriter writer(out, byteOrder);
+	u32 dataSize = writeTables(writer, payloads, alignment);
+	writer.reserve(writer.tell() + dataSize);
+
+	util::MappedFile mapping;
+	for (u32 i = 0; i < mFiles.size(); i++) {
+		if (payloads.mSources[i] != i) continue;
+
+		std::span<const u8> data;
+		r = openData(&data, payloads, i, &mapping);
+		if (r) return r;
+
+		writer.align(alignment);
+		writer.writeBytes(data);
+	}
+
+	// pads the end if the last files are empty, so the size matches the header
+	out.resize(writer.tell());
+	return 0;
+}
 
-		sfatEntry += 0x10;
-		sfntEntry = util::roundUp(sfntEntry + file.mName.length() + 1, 4);
-		dataEnd = dataEntry + file.mData.size();
-		dataEntry = util::roundUp(dataEntry + file.mData.size(), alignment);
+result_t Writer::save(const std::string& filename, util::ByteOrder byteOrder, u32 alignment) {
+#ifndef _WIN32
+	sortFiles();
+
+	Payloads payloads;
+	result_t r = loadPayloads(&payloads);
+	if (r) return r;
+
+	// only the header and tables are built in memory, the file data is written from where it is
+	std::vector<u8> tables;
+	util::BinaryWriter writer(tables, byteOrder);
+	writeTables(writer, payloads, alignment);
+	tables.resize(writer.tell());
+
+	int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return util::Error::FileError;
+
+	const std::vector<u8> padding(alignment);
+	std::vector<iovec> iov;
+	iov.reserve(IOV_BATCH);
+	// files added by path are only kept open until their batch has been written. empty files don't
+	// add a buffer, so this can outgrow its reservation, but moving a mapping keeps its data valid
+	std::vector<util::MappedFile> mappings;
+	mappings.reserve(IOV_BATCH);
+
+	auto add = [&](const void* data, size_t size) {
+		if (size > 0) iov.push_back({ const_cast<void*>(data), size });
+	};
+
+	add(tables.data(), tables.size());
+
+	size_t pos = tables.size();
+	for (u32 i = 0; i < mFiles.size() && !r; i++) {
+		if (payloads.mSources[i] != i) continue;
+
+		// each file adds at most two buffers: the padding and the data
+		if (iov.size() + 2 > IOV_BATCH) {
+			r = writeVectors(fd, iov);
+			mappings.clear();
+			if (r) break;
+		}
+
+		std::span<const u8> data;
+		r = openData(&data, payloads, i, &mappings.emplace_back());
+		if (r) break;
+
+		size_t aligned = util::roundUp(pos, alignment);
+		add(padding.data(), aligned - pos);
+		add(data.data(), data.size());
+		pos = aligned + data.size();
 	}
 
-	// TODO: figure out why file size pre-calculation above doesn't work
-	writer::writeU32LE(out, 0x08, dataEnd);
+	if (!r) r = writeVectors(fd, iov);
+
+	if (::close(fd) != 0 && !r) r = util::Error::FileError;
+	return r;
+#else
+	std::vector<u8> outputBuffer;
+	result_t r = saveToVec(outputBuffer, byteOrder, alignment);
+	if (r) return r;
+	return util::writeFile(filename, outputBuffer);
+#endif
 }
 
-void Writer::save(const std::string& filename, util::ByteOrder byteOrder, u32 alignment) {
+result_t Writer::saveCompressed(
+	const std::string& filename, util::ByteOrder byteOrder, u32 alignment, yaz0::Level level,
+	yaz0::Cache* cache
+) {
+	std::vector<u8> archive;
+	result_t r = saveToVec(archive, byteOrder, alignment);
+	if (r) return r;
+
 	std::vector<u8> outputBuffer;
-	saveToVec(outputBuffer, byteOrder, alignment);
-	util::writeFile(filename, outputBuffer);
+	if (cache)
+		cache->compress(outputBuffer, archive, alignment, level);
+	else
+		yaz0::compress(outputBuffer, archive, alignment, level);
+	return util::writeFile(filename, outputBuffer);
 }
 
 void Writer::addFile(const std::string& filename, const std::vector<u8>& fileData) {
 	mFiles.push_back({ filename, fileData });
 }
 
-u32 Writer::calcHash(const std::string& str) const {
-	u32 hash = 0;
-	const auto strBytes = std::as_bytes(std::span { str.data(), str.size() });
-	for (const std::byte byte : strBytes) {
-		hash = hash * mHashMultiplier + (u8)byte;
-	}
-	return hash;
+void Writer::addFile(const std::string& filename, std::vector<u8>&& fileData) {
+	mFiles.push_back({ filename, std::move(fileData) });
+}
+
+void Writer::addFile(const std::string& filename, std::span<const u8> fileData) {
+	mFiles.push_back({ filename, {}, fileData });
+}
+
+void Writer::addFile(const std::string& filename, const fs::path& path) {
+	mFiles.push_back({ filename, {}, {}, path });
 }
 
 } // namespace sarc
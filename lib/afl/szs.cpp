@@ -0,0 +1,112 @@
+#include "afl/szs.h"
+
+#include <algorithm>
+
+namespace szs {
+
+result_t Archive::init() {
+	result_t r = yaz0::getUncompressedSize(&mSize, mCompressed);
+	if (r) return r;
+
+	if (mSize < 0x14 + 0xc) return yaz0::Error::Truncated;
+	mContents = std::make_unique_for_overwrite<u8[]>(mSize);
+
+	// the header is needed to find where the tables end
+	r = decompressTo(0x14);
+	if (r) return r;
+
+	r = reader::checkSignature(&mContents[0], "SARC", 4);
+	if (r) return r;
+
+	util::ByteOrder byteOrder;
+	r = reader::readByteOrder(&byteOrder, &mContents[6], 0xFEFF);
+	if (r) return r;
+
+	u32 dataOffset = reader::readU32(&mContents[0xc], byteOrder);
+	if (dataOffset > mSize) return yaz0::Error::OutOfRange;
+
+	r = decompressTo(dataOffset);
+	if (r) return r;
+
+	auto reader = std::make_unique<sarc::Reader>(std::span<const u8>(mContents.get(), mSize));
+	r = reader->init();
+	if (r) return r;
+
+	mReader = std::move(reader);
+	return 0;
+}
+
+result_t Archive::getFileView(std::span<const u8>* out, const std::string& filename) {
+	if (!mReader) return util::Error::FileNotFound;
+
+	std::span<const u8> view;
+	result_t r = mReader->getFileView(&view, filename);
+	if (r) return r;
+
+	r = decompressView(view);
+	if (r) return r;
+
+	*out = view;
+	return 0;
+}
+
+result_t Archive::getFileViewByIndex(std::span<const u8>* out, u32 idx) {
+	if (!mReader) return util::Error::FileNotFound;
+
+	std::span<const u8> view;
+	result_t r = mReader->getFileViewByIndex(&view, idx);
+	if (r) return r;
+
+	r = decompressView(view);
+	if (r) return r;
+
+	*out = view;
+	return 0;
+}
+
+result_t Archive::getFileData(std::vector<u8>& out, const std::string& filename) {
+	std::span<const u8> view;
+	result_t r = getFileView(&view, filename);
+	if (r) return r;
+
+	out.assign(view.begin(), view.end());
+	return 0;
+}
+
+result_t Archive::getEntry(sarc::Reader::Entry* out, u32 idx) {
+	if (!mReader || idx >= mReader->getFileCount()) return util::Error::FileNotFound;
+
+	sarc::Reader::Entry entry = mReader->getEntry(idx);
+	result_t r = decompressView(entry.mData);
+	if (r) return r;
+
+	*out = entry;
+	return 0;
+}
+
+result_t Archive::getContents(std::span<const u8>* out) {
+	if (!mReader) return util::Error::FileNotFound;
+
+	result_t r = decompressTo(mSize);
+	if (r) return r;
+
+	*out = { mContents.get(), mSize };
+	return 0;
+}
+
+result_t Archive::decompressTo(size_t end) {
+	if (mOutputPos >= end) return 0;
+
+	return yaz0::decompressPrefix(
+		std::span<u8>(mContents.get(), mSize), mCompressed, std::min<size_t>(end, mSize),
+		&mInputPos, &mOutputPos
+	);
+}
+
+result_t Archive::decompressView(std::span<const u8> view) {
+	if (view.data() + view.size() > mContents.get() + mSize) return yaz0::Error::OutOfRange;
+
+	return decompressTo(view.data() + view.size() - mContents.get());
+}
+
+} // namespace szs
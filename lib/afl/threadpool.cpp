@@ -0,0 +1,102 @@
+#include "afl/threadpool.h"
+
+#include <algorithm>
+
+namespace util {
+
+namespace {
+
+// which pool and queue the current thread works for, if any
+thread_local const ThreadPool* sCurrentPool = nullptr;
+thread_local u32 sCurrentQueue = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(u32 threadCount) {
+	if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (u32 i = 0; i < threadCount; i++)
+		mQueues.push_back(std::make_unique<Queue>());
+	for (u32 i = 0; i < threadCount; i++)
+		mThreads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+
+	{
+		std::lock_guard lock(mMutex);
+		mIsStopping = true;
+	}
+	mWakeCondition.notify_all();
+
+	for (std::thread& thread : mThreads)
+		thread.join();
+}
+
+void ThreadPool::submit(Task task) {
+	u32 index = sCurrentPool == this ? sCurrentQueue : mNextQueue++ % mQueues.size();
+
+	{
+		std::lock_guard lock(mMutex);
+		mPendingCount++;
+		mQueuedCount++;
+	}
+
+	{
+		Queue& queue = *mQueues[index];
+		std::lock_guard lock(queue.mMutex);
+		queue.mTasks.push_back(std::move(task));
+	}
+
+	mWakeCondition.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock lock(mMutex);
+	mDoneCondition.wait(lock, [this] { return mPendingCount == 0; });
+}
+
+void ThreadPool::run(u32 index) {
+	sCurrentPool = this;
+	sCurrentQueue = index;
+
+	while (true) {
+		Task task;
+		if (pop(&task, index)) {
+			task();
+
+			std::lock_guard lock(mMutex);
+			if (--mPendingCount == 0) mDoneCondition.notify_all();
+			continue;
+		}
+
+		std::unique_lock lock(mMutex);
+		mWakeCondition.wait(lock, [this] { return mIsStopping || mQueuedCount > 0; });
+		if (mIsStopping && mQueuedCount == 0) return;
+	}
+}
+
+bool ThreadPool::pop(Task* task, u32 index) {
+	for (u32 i = 0; i < mQueues.size(); i++) {
+		Queue& queue = *mQueues[(index + i) % mQueues.size()];
+		std::lock_guard lock(queue.mMutex);
+		if (queue.mTasks.empty()) continue;
+
+		// newest from our own queue, oldest from anyone else's
+		if (i == 0) {
+			*task = std::move(queue.mTasks.back());
+			queue.mTasks.pop_back();
+		} else {
+			*task = std::move(queue.mTasks.front());
+			queue.mTasks.pop_front();
+		}
+
+		mQueuedCount--;
+		return true;
+	}
+
+	return false;
+}
+
+} // namespace util
@@ -5,7 +5,21 @@
 #include <cstdio>
 #include <cstring>
 #include <fstream>
-#include <iterator>
+#include <utility>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+# include <cerrno>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
 
 namespace util {
 u16 bswap16(u16 value) {
@@ -17,10 +31,122 @@ u32 bswap32(u32 value) {
 	       ((value & 0x00ff0000) >> 8) | ((value & 0xff000000) >> 24);
 }
 
+namespace {
+
+#if defined(__SSE2__)
+// SSE2 has no byte shuffle, so this swaps the bytes of each 16-bit word with shifts and then
+// reverses the order of the words within each element
+template <typename T>
+__m128i byteswapBlock(__m128i block) {
+	block = _mm_or_si128(_mm_slli_epi16(block, 8), _mm_srli_epi16(block, 8));
+	if constexpr (sizeof(T) == 4)
+		block = _mm_shufflehi_epi16(_mm_shufflelo_epi16(block, 0xb1), 0xb1);
+	else if constexpr (sizeof(T) == 8)
+		block = _mm_shufflehi_epi16(_mm_shufflelo_epi16(block, 0x1b), 0x1b);
+	return block;
+}
+#endif
+
+// swaps 32 or 16 bytes at a time where the target supports it, and the rest one element at a time
+template <typename T>
+void byteswapElements(u8* dst, const u8* src, size_t count) {
+	const size_t size = count * sizeof(T);
+	size_t pos = 0;
+
+#if defined(__AVX2__)
+	alignas(32) u8 indices[32];
+	for (u32 i = 0; i < 32; i++)
+		indices[i] = (i % 16) / sizeof(T) * sizeof(T) + sizeof(T) - 1 - i % sizeof(T);
+	const __m256i shuffle = _mm256_load_si256(reinterpret_cast<const __m256i*>(indices));
+
+	for (; pos + 32 <= size; pos += 32) {
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + pos));
+		block = _mm256_shuffle_epi8(block, shuffle);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + pos), block);
+	}
+#endif
+
+#if defined(__SSE2__)
+	for (; pos + 16 <= size; pos += 16) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), byteswapBlock<T>(block));
+	}
+#endif
+
+	for (; pos < size; pos += sizeof(T)) {
+		T value;
+		std::memcpy(&value, src + pos, sizeof(T));
+		value = byteswap(value);
+		std::memcpy(dst + pos, &value, sizeof(T));
+	}
+}
+
+} // namespace
+
+void byteswapArray(void* dst, const void* src, size_t count, u32 elemSize) {
+	u8* out = static_cast<u8*>(dst);
+	const u8* in = static_cast<const u8*>(src);
+
+	switch (elemSize) {
+	case 2: byteswapElements<u16>(out, in, count); break;
+	case 4: byteswapElements<u32>(out, in, count); break;
+	case 8: byteswapElements<u64>(out, in, count); break;
+	default: std::memmove(out, in, count * elemSize); break;
+	}
+}
+
 bool isEqual(std::string str1, std::string str2) {
 	return std::strcmp(str1.c_str(), str2.c_str()) == 0;
 }
 
+// xxHash64, which processes 32 bytes per step in 4 independent lanes
+u64 hash64(std::span<const u8> data, u64 seed) {
+	constexpr u64 PRIME1 = 0x9e3779b185ebca87;
+	constexpr u64 PRIME2 = 0xc2b2ae3d27d4eb4f;
+	constexpr u64 PRIME3 = 0x165667b19e3779f9;
+	constexpr u64 PRIME4 = 0x85ebca77c2b2ae63;
+	constexpr u64 PRIME5 = 0x27d4eb2f165667c5;
+
+	auto round = [](u64 acc, u64 value) { return std::rotl(acc + value * PRIME2, 31) * PRIME1; };
+	auto merge = [&](u64 acc, u64 value) { return (acc ^ round(0, value)) * PRIME1 + PRIME4; };
+
+	const u8* ptr = data.data();
+	const u8* end = ptr + data.size();
+	u64 hash;
+
+	if (data.size() >= 32) {
+		u64 lanes[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 };
+		for (; ptr + 32 <= end; ptr += 32)
+			for (s32 i = 0; i < 4; i++)
+				lanes[i] = round(lanes[i], reader::readU64LE(ptr + 8 * i));
+
+		hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) +
+		       std::rotl(lanes[3], 18);
+		for (u64 lane : lanes)
+			hash = merge(hash, lane);
+	} else {
+		hash = seed + PRIME5;
+	}
+
+	hash += data.size();
+
+	for (; ptr + 8 <= end; ptr += 8)
+		hash = std::rotl(hash ^ round(0, reader::readU64LE(ptr)), 27) * PRIME1 + PRIME4;
+	if (ptr + 4 <= end) {
+		hash = std::rotl(hash ^ (reader::readU32LE(ptr) * PRIME1), 23) * PRIME2 + PRIME3;
+		ptr += 4;
+	}
+	for (; ptr < end; ptr++)
+		hash = std::rotl(hash ^ (*ptr * PRIME5), 11) * PRIME1;
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
 u32 roundUp(u32 x, u32 powerOf2) {
 	u32 a = powerOf2 - 1;
 	return (x + a) & ~a;
@@ -33,197 +159,153 @@ result_t readFile(std::vector<u8>& contents, const fs::path& filename) {
 		return Error::FileError;
 	}
 
-	// disable skipping whitespace in binary file
-	fstream.unsetf(std::ios::skipws);
-
 	fstream.seekg(0, std::ios_base::end);
 	std::streampos fileSize = fstream.tellg();
 	fstream.seekg(0, std::ios_base::beg);
+	if (fileSize < 0) return Error::FileError;
 
-	contents.reserve(fileSize);
-	contents.insert(
-		contents.begin(), std::istream_iterator<u8>(fstream), std::istream_iterator<u8>()
-	);
-
-	fstream.close();
+	contents.resize(fileSize);
+	fstream.read(reinterpret_cast<char*>(contents.data()), fileSize);
+	if (fstream.gcount() != fileSize) {
+		contents.clear();
+		return Error::FileError;
+	}
 
 	return 0;
 }
 
-void writeFile(const fs::path& filename, const std::vector<u8>& contents) {
+result_t writeFile(const fs::path& filename, std::span<const u8> contents) {
 	std::ofstream fstream(filename, std::ios::out | std::ios::binary);
+	if (!fstream) return Error::FileError;
+
 	fstream.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+	// a failed flush, e.g. when the disk is full, only shows up when the file is closed
+	fstream.close();
+	return fstream ? 0 : Error::FileError;
 }
 
-void writeFile(const fs::path& filename, const std::string& contents) {
+result_t writeFile(const fs::path& filename, const std::string& contents) {
 	std::ofstream fstream(filename, std::ios::out);
-	fstream.write(contents.c_str(), contents.size());
-}
-
-} // namespace util
-
-namespace reader {
-result_t readByteOrder(util::ByteOrder* out, const u8* offset, u16 expectedBE) {
-	u16 mark = (offset[0] << 8) | offset[1];
-	if (mark == expectedBE)
-		*out = util::ByteOrder::Big;
-	else if (mark == util::bswap16(expectedBE))
-		*out = util::ByteOrder::Little;
-	else
-		return util::Error::BadByteOrder;
-
-	return 0;
-}
-
-result_t checkSignature(const u8* offset, const std::string& expected, size_t length) {
-	for (size_t i = 0; i < length; i++)
-		if (offset[i] != expected[i]) return util::Error::BadSignature;
-
-	return 0;
-}
-
-u8 readU8(const u8* offset) {
-	return *offset;
-}
-
-s8 readS8(const u8* offset) {
-	return std::bit_cast<s8>(readU8(offset));
-}
-
-u16 readU16BE(const u8* offset) {
-	return (offset[0] << 8) | (offset[1] << 0);
-}
+	if (!fstream) return Error::FileError;
 
-u16 readU16LE(const u8* offset) {
-	return (offset[0] << 0) | (offset[1] << 8);
-}
-
-u16 readU16(const u8* offset, util::ByteOrder byteOrder) {
-	if (byteOrder == util::ByteOrder::Big)
-		return readU16BE(offset);
-	else
-		return readU16LE(offset);
-}
-
-s16 readS16BE(const u8* offset) {
-	return std::bit_cast<s16>(readU16BE(offset));
-}
-
-s16 readS16LE(const u8* offset) {
-	return std::bit_cast<s16>(readU16LE(offset));
-}
-
-s16 readS16(const u8* offset, util::ByteOrder byteOrder) {
-	return std::bit_cast<s16>(readU16(offset, byteOrder));
-}
-
-f16 readF16BE(const u8* offset) {
-	return std::bit_cast<f16>(readU16BE(offset));
+	fstream.write(contents.c_str(), contents.size());
+	fstream.close();
+	return fstream ? 0 : Error::FileError;
 }
 
-f16 readF16LE(const u8* offset) {
-	return std::bit_cast<f16>(readU16LE(offset));
-}
+namespace {
 
-f16 readF16(const u8* offset, util::ByteOrder byteOrder) {
-	return std::bit_cast<f16>(readU16(offset, byteOrder));
-}
+// files smaller than this are read instead of mapped
+constexpr size_t MAP_THRESHOLD = 0x10000;
 
-u32 readU24BE(const u8* offset) {
-	return (offset[0] << 16) | (offset[1] << 8) | (offset[2] << 0);
-}
+} // namespace
 
-u32 readU24LE(const u8* offset) {
-	return (offset[0] << 0) | (offset[1] << 8) | (offset[2] << 16);
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+	*this = std::move(other);
 }
 
-u32 readU24(const u8* offset, util::ByteOrder byteOrder) {
-	if (byteOrder == util::ByteOrder::Big)
-		return readU24BE(offset);
-	else
-		return readU24LE(offset);
+MappedFile::~MappedFile() {
+	close();
 }
 
-u32 readU32BE(const u8* offset) {
-	return (offset[0] << 24) | (offset[1] << 16) | (offset[2] << 8) | offset[3];
-}
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		mData = std::exchange(other.mData, nullptr);
+		mSize = std::exchange(other.mSize, 0);
+		mIsMapped = std::exchange(other.mIsMapped, false);
+		mBuffer = std::move(other.mBuffer);
+	}
 
-u32 readU32LE(const u8* offset) {
-	return offset[0] | (offset[1] << 8) | (offset[2] << 16) | (offset[3] << 24);
+	return *this;
 }
 
-u32 readU32(const u8* offset, util::ByteOrder byteOrder) {
-	if (byteOrder == util::ByteOrder::Big)
-		return readU32BE(offset);
-	else
-		return readU32LE(offset);
-}
+result_t MappedFile::open(const fs::path& filename) {
+	close();
 
-s32 readS32BE(const u8* offset) {
-	return std::bit_cast<s32>(readU32BE(offset));
-}
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return errno == ENOENT ? Error::FileNotFound : Error::FileError;
 
-s32 readS32LE(const u8* offset) {
-	return std::bit_cast<s32>(readU32LE(offset));
-}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		::close(fd);
+		return Error::FileError;
+	}
 
-s32 readS32(const u8* offset, util::ByteOrder byteOrder) {
-	return std::bit_cast<s32>(readU32(offset, byteOrder));
-}
+	size_t size = st.st_size;
+	if (size >= MAP_THRESHOLD) {
+		void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED) return Error::FileError;
 
-f32 readF32BE(const u8* offset) {
-	return std::bit_cast<f32>(readU32BE(offset));
-}
+		mData = static_cast<const u8*>(data);
+		mSize = size;
+		mIsMapped = true;
+		return 0;
+	}
 
-f32 readF32LE(const u8* offset) {
-	return std::bit_cast<f32>(readU32LE(offset));
+	mBuffer.resize(size);
+	for (size_t done = 0; done < size;) {
+		ssize_t count = ::read(fd, mBuffer.data() + done, size - done);
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) {
+			::close(fd);
+			mBuffer.clear();
+			return Error::FileError;
+		}
+		done += count;
+	}
+	::close(fd);
+#else
+	result_t r = readFile(mBuffer, filename);
+	if (r) return r;
+#endif
+
+	mData = mBuffer.data();
+	mSize = mBuffer.size();
+	return 0;
 }
 
-f32 readF32(const u8* offset, util::ByteOrder byteOrder) {
-	return std::bit_cast<f32>(readU32(offset, byteOrder));
-}
+void MappedFile::close() {
+#ifndef _WIN32
+	if (mIsMapped) munmap(const_cast<u8*>(mData), mSize);
+#endif
 
-u64 readU64BE(const u8* offset) {
-	return ((u64)offset[0] << 56) | ((u64)offset[1] << 48) | ((u64)offset[2] << 40) |
-	       ((u64)offset[3] << 32) | ((u64)offset[4] << 24) | ((u64)offset[5] << 16) |
-	       ((u64)offset[6] << 8) | ((u64)offset[7] << 0);
+	mData = nullptr;
+	mSize = 0;
+	mIsMapped = false;
+	mBuffer = {};
 }
 
-u64 readU64LE(const u8* offset) {
-	return ((u64)offset[0] << 0) | ((u64)offset[1] << 8) | ((u64)offset[2] << 16) |
-	       ((u64)offset[3] << 24) | ((u64)offset[4] << 32) | ((u64)offset[5] << 40) |
-	       ((u64)offset[6] << 48) | ((u64)offset[7] << 56);
-}
+} // namespace util
 
-u64 readU64(const u8* offset, util::ByteOrder byteOrder) {
-	if (byteOrder == util::ByteOrder::Big)
-		return readU64BE(offset);
+namespace reader {
+result_t readByteOrder(util::ByteOrder* out, const u8* offset, u16 expectedBE) {
+	u16 mark = (offset[0] << 8) | offset[1];
+	if (mark == expectedBE)
+		*out = util::ByteOrder::Big;
+	else if (mark == util::bswap16(expectedBE))
+		*out = util::ByteOrder::Little;
 	else
-		return readU64LE(offset);
-}
-
-s64 readS64BE(const u8* offset) {
-	return std::bit_cast<s64>(readU64BE(offset));
-}
+		return util::Error::BadByteOrder;
 
-s64 readS64LE(const u8* offset) {
-	return std::bit_cast<s64>(readU64LE(offset));
+	return 0;
 }
 
-s64 readS64(const u8* offset, util::ByteOrder byteOrder) {
-	return std::bit_cast<s64>(readU64(offset, byteOrder));
-}
+result_t checkSignature(const u8* offset, const std::string& expected, size_t length) {
+	for (size_t i = 0; i < length; i++)
+		if (offset[i] != expected[i]) return util::Error::BadSignature;
 
-f64 readF64BE(const u8* offset) {
-	return std::bit_cast<f64>(readU64BE(offset));
+	return 0;
 }
 
-f64 readF64LE(const u8* offset) {
-	return std::bit_cast<f64>(readU64LE(offset));
+u8 readU8(const u8* offset) {
+	return *offset;
 }
 
-f64 readF64(const u8* offset, util::ByteOrder byteOrder) {
-	return std::bit_cast<f64>(readU64(offset, byteOrder));
+s8 readS8(const u8* offset) {
+	return std::bit_cast<s8>(readU8(offset));
 }
 
 const std::string readString(const u8* offset) {
@@ -407,9 +489,11 @@ void writeString(
 	if (isNullTerminated) writeU8(buffer, offset + str.size(), 0);
 }
 
-void writeBytes(std::vector<u8>& buffer, size_t offset, const std::vector<u8>& bytes) {
-	for (size_t i = 0; i < bytes.size(); i++)
-		writeU8(buffer, offset + i, bytes[i]);
+void writeBytes(std::vector<u8>& buffer, size_t offset, std::span<const u8> bytes) {
+	if (bytes.empty()) return;
+	if (offset + bytes.size() > buffer.size()) buffer.resize(offset + bytes.size());
+
+	std::memcpy(&buffer[offset], bytes.data(), bytes.size());
 }
 
 } // namespace writer
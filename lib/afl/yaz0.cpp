@@ -4,138 +4,1098 @@
 #include "afl/yaz0.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <thread>
 
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "afl/threadpool.h"
 #include "afl/types.h"
 #include "afl/util.h"
 
 namespace yaz0 {
 
-result_t decompress(std::vector<u8>& output, const std::vector<u8>& input) {
-	u8 magic[4] = { input[0], input[1], input[2], input[3] };
-	if (magic[0] != 'Y' || magic[1] != 'a' || magic[2] != 'z' || magic[3] != '0') {
-		return util::Error::BadSignature;
+namespace {
+
+constexpr u32 HEADER_SIZE = 0x10;
+constexpr u32 WINDOW_SIZE = 0x1000;
+constexpr u32 MIN_MATCH = 3;
+constexpr u32 MAX_MATCH = 0x111;
+
+// a group is at most one code byte and 8 3-byte tokens, writing at most 8 maximum length
+// back-references plus the overrun of the last one when copying in words
+constexpr u32 MAX_GROUP_INPUT = 1 + 8 * 3;
+constexpr u32 MAX_GROUP_OUTPUT = 8 * MAX_MATCH + 8;
+
+constexpr u32 HASH_BITS = 15;
+constexpr u32 HASH_SIZE = 1 << HASH_BITS;
+constexpr u32 NO_POS = 0xffffffff;
+
+// number of candidates checked per position before settling on the best match so far
+constexpr u32 MAX_CHAIN_FAST = 1;
+constexpr u32 MAX_CHAIN_NORMAL = 0x100;
+
+// amount of output decoded at a time by `decompressRange` before discarding all but the window
+constexpr u32 RANGE_CHUNK_SIZE = 0x10000;
+
+// size of the pieces of input handed to each thread by `compressParallel`
+constexpr u32 PARALLEL_SEGMENT_SIZE = 0x100000;
+
+// temporary files in the cache which are older than this were left behind by a writer which
+// didn't finish, since a write only takes as long as compressing one file
+constexpr std::chrono::hours CACHE_TEMP_MAX_AGE(1);
+
+// the optimal parse is run over blocks of this size to bound its memory usage
+constexpr u32 OPTIMAL_BLOCK_SIZE = 0x40000;
+// enough levels for a range covering every long match length (0x12 to 0x111)
+constexpr u32 RANGE_MIN_LEVELS = 9;
+
+// encoded size of each token in bits, including its bit in the code byte
+constexpr u32 LITERAL_COST = 9;
+constexpr u32 SHORT_MATCH_COST = 17;
+constexpr u32 LONG_MATCH_COST = 25;
+
+u32 hash3(const u8* data) {
+	u32 value = (data[0] << 16) | (data[1] << 8) | data[2];
+	return (value * 0x9e3779b1) >> (32 - HASH_BITS);
+}
+
+// number of leading bytes which are equal in `a` and `b`, up to `maxLength`. compares 32 or 16
+// bytes at a time where the target supports it, otherwise 8, and finds the first mismatch in a
+// block by counting trailing zeros
+u32 matchLength(const u8* a, const u8* b, u32 maxLength) {
+	u32 length = 0;
+
+#if defined(__AVX2__)
+	while (length + 32 <= maxLength) {
+		__m256i blockA = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + length));
+		__m256i blockB = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + length));
+		u32 mismatch = ~static_cast<u32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(blockA, blockB)));
+		if (mismatch != 0) return length + std::countr_zero(mismatch);
+		length += 32;
 	}
+#endif
 
-	u32 uncompressedSize = reader::readU32(&input[4], util::ByteOrder::Big);
-	u32 alignment = reader::readU32(&input[8], util::ByteOrder::Big);
+#if defined(__SSE2__)
+	while (length + 16 <= maxLength) {
+		__m128i blockA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + length));
+		__m128i blockB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + length));
+		u32 mismatch = ~_mm_movemask_epi8(_mm_cmpeq_epi8(blockA, blockB)) & 0xffff;
+		if (mismatch != 0) return length + std::countr_zero(mismatch);
+		length += 16;
+	}
+#endif
 
-	output.resize(uncompressedSize);
+	while (length + 8 <= maxLength) {
+		u64 blockA, blockB;
+		std::memcpy(&blockA, a + length, 8);
+		std::memcpy(&blockB, b + length, 8);
+		u64 mismatch = blockA ^ blockB;
+		if (mismatch != 0) {
+			if constexpr (std::endian::native == std::endian::little)
+				return length + std::countr_zero(mismatch) / 8;
+			else
+				return length + std::countl_zero(mismatch) / 8;
+		}
+		length += 8;
+	}
 
-	u32 source = 0x10;
-	u32 dest = 0;
+	while (length < maxLength && a[length] == b[length])
+		length++;
+	return length;
+}
+
+// hash chains over the sliding window. `mHead` holds the most recent position for each hash
+// of 3 bytes, and `mPrev` links each position in the window to the previous one with the same
+// hash, so only positions which can actually start a match are ever compared. matches never
+// extend past `end`, and the window before `start` is inserted up front
+class MatchFinder {
+public:
+	MatchFinder(const u8* data, u32 start, u32 end) :
+		mData(data), mEnd(end), mHead(HASH_SIZE, NO_POS), mPrev(WINDOW_SIZE, NO_POS) {
+		for (u32 pos = start > WINDOW_SIZE ? start - WINDOW_SIZE : 0; pos < start; pos++)
+			insert(pos);
+	}
+
+	void insert(u32 pos) {
+		if (pos + MIN_MATCH > mEnd) return;
+
+		u32 hash = hash3(&mData[pos]);
+		mPrev[pos % WINDOW_SIZE] = mHead[hash];
+		mHead[hash] = pos;
+	}
+
+	// returns the length of the longest match for `pos` found within `maxChain` candidates,
+	// and stores where it starts in `matchPos`. must be called before `pos` is inserted
+	u32 find(u32* matchPos, u32 pos, u32 maxChain) const {
+		if (pos + MIN_MATCH > mEnd) return 0;
+
+		const u8* current = &mData[pos];
+		u32 maxLength = std::min<u32>(MAX_MATCH, mEnd - pos);
+		u32 bestLength = 0;
+
+		u32 candidate = mHead[hash3(current)];
+		for (u32 i = 0; i < maxChain; i++) {
+			if (candidate == NO_POS || pos - candidate > WINDOW_SIZE) break;
+
+			const u8* source = &mData[candidate];
+			// cheap rejection: a better match must at least agree on the byte after the best one
+			if (source[bestLength] == current[bestLength]) {
+				u32 length = matchLength(source, current, maxLength);
+				if (length > bestLength) {
+					bestLength = length;
+					*matchPos = candidate;
+					if (length == maxLength) break;
+				}
+			}
+
+			candidate = mPrev[candidate % WINDOW_SIZE];
+		}
+
+		return bestLength;
+	}
+
+private:
+	const u8* mData;
+	u32 mEnd;
+	std::vector<u32> mHead;
+	std::vector<u32> mPrev;
+};
+
+// packs tokens into groups of 8, each group preceded by a code byte with one bit per token
+class GroupWriter {
+public:
+	GroupWriter(std::vector<u8>& output) : mOutput(output) {}
+
+	void writeLiteral(u8 value) {
+		beginToken(true);
+		mOutput.push_back(value);
+	}
+
+	void writeMatch(u32 distance, u32 count) {
+		beginToken(false);
+
+		u16 offset = (distance - 1) & 0xfff;
+		if (count < 0x12) {
+			// 2-byte compressed data
+			mOutput.push_back((count - 2) << 4 | offset >> 8);
+			mOutput.push_back(offset & 0xff);
+		} else {
+			// 3-byte compressed data
+			mOutput.push_back(offset >> 8);
+			mOutput.push_back(offset & 0xff);
+			mOutput.push_back(count - 0x12);
+		}
+	}
+
+	// appends every token written by `other`, which must have started on an empty buffer
+	void append(const GroupWriter& other) {
+		const std::vector<u8>& stream = other.mOutput;
+
+		// if this writer is between groups, the other stream's groups line up with ours
+		if (mBitsLeft == 0) {
+			size_t base = mOutput.size();
+			mOutput.insert(mOutput.end(), stream.begin(), stream.end());
+			mCodeBytePos = base + other.mCodeBytePos;
+			mBitsLeft = other.mBitsLeft;
+			return;
+		}
+
+		// otherwise every token has to be moved to a different bit of a different code byte
+		size_t pos = 0;
+		while (pos < stream.size()) {
+			size_t codeBytePos = pos++;
+			u8 codeByte = stream[codeBytePos];
+			u32 tokenCount = codeBytePos == other.mCodeBytePos ? 8 - other.mBitsLeft : 8;
+
+			for (u32 i = 0; i < tokenCount; i++) {
+				bool isLiteral = (codeByte >> (7 - i)) & 0x01;
+				u32 size = isLiteral ? 1 : (stream[pos] >> 4 == 0 ? 3 : 2);
+
+				beginToken(isLiteral);
+				mOutput.insert(mOutput.end(), stream.begin() + pos, stream.begin() + pos + size);
+				pos += size;
+			}
+		}
+	}
+
+private:
+	void beginToken(bool isLiteral) {
+		if (mBitsLeft == 0) {
+			mCodeBytePos = mOutput.size();
+			mOutput.push_back(0);
+			mBitsLeft = 8;
+		}
+
+		mBitsLeft--;
+		if (isLiteral) mOutput[mCodeBytePos] |= 1 << mBitsLeft;
+	}
+
+	std::vector<u8>& mOutput;
+	size_t mCodeBytePos = 0;
+	u32 mBitsLeft = 0;
+};
+
+// takes the longest match at each position. with `insertMatched` unset, positions covered by a
+// match are not added to the hash chains, trading ratio for speed
+void compressGreedy(
+	GroupWriter& groups, const u8* input, u32 start, u32 end, u32 maxChain, bool insertMatched
+) {
+	MatchFinder finder(input, start, end);
+
+	u32 readPtr = start;
+	while (readPtr < end) {
+		u32 matchPos;
+		u32 count = finder.find(&matchPos, readPtr, maxChain);
+
+		if (count < MIN_MATCH) {
+			groups.writeLiteral(input[readPtr]);
+			finder.insert(readPtr);
+			readPtr++;
+			continue;
+		}
+
+		groups.writeMatch(readPtr - matchPos, count);
+		if (insertMatched) {
+			for (u32 i = 0; i < count; i++)
+				finder.insert(readPtr + i);
+		} else {
+			finder.insert(readPtr);
+		}
+		readPtr += count;
+	}
+}
+
+// finds the longest match at every position, then picks the sequence of tokens with the
+// smallest total size by working backwards from the end of each block. since any prefix of a
+// match is also a match, every length from 3 up to the longest one is considered. tokens may run
+// past the end of a block, in which case the next block starts where the last one ends
+void compressOptimal(GroupWriter& groups, const u8* input, u32 start, u32 end) {
+	MatchFinder finder(input, start, end);
+
+	u32 maxBlockSize = std::min<u32>(OPTIMAL_BLOCK_SIZE, end - start);
+	std::vector<u16> counts(maxBlockSize);
+	std::vector<u32> positions(maxBlockSize);
+	std::vector<u32> costs(maxBlockSize + MAX_MATCH + 1);
 
-	while (dest < uncompressedSize) {
-		u8 codeByte = input.at(source++);
-		for (s8 i = 7; i >= 0; i--) {
-			if (dest >= uncompressedSize) break;
+	// every long match costs the same, so the best one is whichever ends at the cheapest
+	// position. `minPos[k - 1][i]` is the cheapest position in [i, i + 2^k), which turns that
+	// into two lookups instead of a scan over up to 0x100 positions
+	std::array<std::vector<u32>, RANGE_MIN_LEVELS> minPos;
+	for (auto& level : minPos)
+		level.resize(costs.size());
 
-			bool isCopy = (codeByte >> i) & 0x01;
-			if (isCopy) {
-				output.at(dest++) = input.at(source++);
+	auto cheapest = [&](u32 level, u32 pos) { return level == 0 ? pos : minPos[level - 1][pos]; };
+	// on a tie, prefer the later position so that matches are as long as possible
+	auto cheaper = [&](u32 a, u32 b) { return costs[a] < costs[b] ? a : b; };
+
+	u32 blockStart = start;
+	while (blockStart < end) {
+		u32 blockSize = std::min<u32>(OPTIMAL_BLOCK_SIZE, end - blockStart);
+
+		u32 derived = 0;
+		for (u32 i = 0; i < blockSize; i++) {
+			u32 pos = blockStart + i;
+
+			// after a maximum length match, the same match shifted along by one is at least as
+			// long minus one, so extend that instead of searching again until it gets too short
+			if (derived > 0 && counts[i - 1] > MIN_MATCH) {
+				u32 count = counts[i - 1] - 1;
+				u32 maxCount = std::min<u32>(MAX_MATCH, end - pos);
+				positions[i] = positions[i - 1] + 1;
+				counts[i] = count + matchLength(
+										&input[positions[i] + count], &input[pos + count],
+										maxCount - count
+									);
+				derived--;
 			} else {
-				u16 data = reader::readU16(&input[source], util::ByteOrder::Big);
-				source += 2;
+				counts[i] = finder.find(&positions[i], pos, WINDOW_SIZE);
+				if (counts[i] == MAX_MATCH) derived = MAX_MATCH / 2;
+			}
+			finder.insert(pos);
+		}
 
-				u16 count = data >> 0xc;
-				if (count == 0)
-					count = input.at(source++) + 0x12;
-				else
-					count += 2;
+		// anything past the end of the block is left for the next one, so it costs nothing here.
+		// `counts` is reused to hold the chosen token length at each position (1 for a literal)
+		u32 lastPos = blockSize + MAX_MATCH;
+		for (u32 i = lastPos + 1; i-- > 0;) {
+			if (i >= blockSize) {
+				costs[i] = 0;
+			} else {
+				u32 maxCount = counts[i];
+				costs[i] = costs[i + 1] + LITERAL_COST;
+				counts[i] = 1;
 
-				u16 offset = (data & 0xfff) + 1;
+				for (u32 count = MIN_MATCH; count <= std::min<u32>(maxCount, 0x11); count++) {
+					u32 cost = costs[i + count] + SHORT_MATCH_COST;
+					if (cost <= costs[i]) {
+						costs[i] = cost;
+						counts[i] = count;
+					}
+				}
 
-				for (s32 j = 0; j < count; j++) {
-					output.at(dest) = output.at(dest - offset);
-					dest++;
+				if (maxCount >= 0x12) {
+					u32 first = i + 0x12;
+					u32 last = i + maxCount;
+					u32 level = std::bit_width(last - first + 1) - 1;
+					u32 end =
+						cheaper(cheapest(level, first), cheapest(level, last - (1 << level) + 1));
+					if (costs[end] + LONG_MATCH_COST <= costs[i]) {
+						costs[i] = costs[end] + LONG_MATCH_COST;
+						counts[i] = end - i;
+					}
 				}
 			}
+
+			for (u32 level = 1; level < RANGE_MIN_LEVELS; level++) {
+				u32 half = 1 << (level - 1);
+				if (i + 2 * half > lastPos + 1) break;
+				minPos[level - 1][i] =
+					cheaper(cheapest(level - 1, i), cheapest(level - 1, i + half));
+			}
+		}
+
+		u32 i = 0;
+		while (i < blockSize) {
+			if (counts[i] == 1)
+				groups.writeLiteral(input[blockStart + i]);
+			else
+				groups.writeMatch(blockStart + i - positions[i], counts[i]);
+			i += counts[i];
+		}
+
+		for (u32 pos = blockStart + blockSize; pos < blockStart + i; pos++)
+			finder.insert(pos);
+		blockStart += i;
+	}
+}
+
+void compressRange(GroupWriter& groups, const u8* input, u32 start, u32 end, Level level) {
+	switch (level) {
+	case Level::Fast: compressGreedy(groups, input, start, end, MAX_CHAIN_FAST, false); break;
+	case Level::Normal: compressGreedy(groups, input, start, end, MAX_CHAIN_NORMAL, true); break;
+	case Level::Max: compressOptimal(groups, input, start, end); break;
+	}
+}
+
+// copies a back-reference 8 bytes at a time, which may write up to 7 bytes past `count`
+inline void copyMatch(u8* dest, u32 distance, u32 count) {
+	const u8* source = dest - distance;
+
+	// far enough back that the source is never overwritten
+	if (distance >= count && count >= 0x20) {
+		std::memcpy(dest, source, count);
+		return;
+	}
+
+	u32 i = 0;
+	if (distance < 8) {
+		// repeat the pattern byte by byte until it's at least 8 bytes long. the rest of the run
+		// then repeats every multiple of `distance` as well, so it can be copied in words
+		for (; i < 8; i++)
+			dest[i] = source[i];
+		source = dest - distance * ((8 + distance - 1) / distance);
+	}
+
+	for (; i < count; i += 8)
+		std::memcpy(dest + i, source + i, 8);
+}
+
+// decodes groups of tokens starting at `*source` in `input` into `output`, starting at `*dest`,
+// until the first group boundary at or after `stop`. no more than `end` bytes of `output` are ever
+// written, cutting the last back-reference short if needed. everything before `*dest` must already
+// be decoded, since back-references are copied from it directly. bounds are checked once per group
+// wherever there is room for a whole group in both the input and the output, and once per token
+// otherwise
+result_t decodeGroups(
+	u8* output, u32 stop, u32 end, std::span<const u8> input, size_t* source, u32* dest
+) {
+	const u8* in = input.data();
+	size_t inSize = input.size();
+	size_t src = *source;
+	u32 dst = *dest;
+
+	while (dst < stop && src + MAX_GROUP_INPUT <= inSize && end - dst >= MAX_GROUP_OUTPUT) {
+		u8 codeByte = in[src++];
+
+		// a whole group of literals, common in data that doesn't compress well
+		if (codeByte == 0xff) {
+			std::memcpy(&output[dst], &in[src], 8);
+			src += 8;
+			dst += 8;
+			continue;
+		}
+
+		for (s32 i = 7; i >= 0; i--) {
+			if ((codeByte >> i) & 0x01) {
+				output[dst++] = in[src++];
+				continue;
+			}
+
+			u32 count = in[src] >> 4;
+			u32 distance = (((in[src] & 0xf) << 8) | in[src + 1]) + 1;
+			src += 2;
+			if (count == 0)
+				count = in[src++] + 0x12;
+			else
+				count += 2;
+
+			if (distance > dst) return Error::InvalidOffset;
+			copyMatch(&output[dst], distance, count);
+			dst += count;
 		}
 	}
 
+	while (dst < stop) {
+		if (src >= inSize) return Error::Truncated;
+
+		u8 codeByte = in[src++];
+		for (s32 i = 7; i >= 0 && dst < end; i--) {
+			if ((codeByte >> i) & 0x01) {
+				if (src >= inSize) return Error::Truncated;
+				output[dst++] = in[src++];
+				continue;
+			}
+
+			if (src + 2 > inSize) return Error::Truncated;
+			u32 count = in[src] >> 4;
+			u32 distance = (((in[src] & 0xf) << 8) | in[src + 1]) + 1;
+			src += 2;
+			if (count == 0) {
+				if (src >= inSize) return Error::Truncated;
+				count = in[src++] + 0x12;
+			} else {
+				count += 2;
+			}
+
+			if (distance > dst) return Error::InvalidOffset;
+			count = std::min(count, end - dst);
+			for (u32 j = 0; j < count; j++, dst++)
+				output[dst] = output[dst - distance];
+		}
+	}
+
+	*source = src;
+	*dest = dst;
+	return 0;
+}
+
+// decodes the part of the output in [offset, offset + output.size()) into `output`, starting
+// from a group boundary at `source` in the input which produces output from `start`, with
+// `history` holding the output just before `start`. only a window of recent output is kept while
+// decoding up to `offset`, rather than everything before it
+result_t decodeRange(
+	std::span<u8> output, std::span<const u8> input, u32 uncompressedSize, u32 offset,
+	size_t source, u32 start, std::span<const u8> history
+) {
+	if (output.empty()) return 0;
+
+	std::vector<u8> scratch(WINDOW_SIZE + RANGE_CHUNK_SIZE + MAX_GROUP_OUTPUT);
+	std::copy(history.begin(), history.end(), scratch.begin());
+
+	// `scratch[0]` holds the output at `base`
+	u32 base = start - history.size();
+	u32 dest = history.size();
+	u32 rangeEnd = offset + output.size();
+	u32 copied = offset;
+
+	while (true) {
+		u32 stop = std::min<u32>(WINDOW_SIZE + RANGE_CHUNK_SIZE, uncompressedSize - base);
+		u32 end = std::min<u32>(scratch.size(), uncompressedSize - base);
+		result_t r = decodeGroups(scratch.data(), stop, end, input, &source, &dest);
+		if (r) return r;
+
+		// copy whatever part of the range was just decoded
+		u32 copyEnd = std::min(rangeEnd, base + dest);
+		if (copied < copyEnd) {
+			std::memcpy(&output[copied - offset], &scratch[copied - base], copyEnd - copied);
+			copied = copyEnd;
+		}
+
+		if (copied == rangeEnd) return 0;
+
+		// keep the most recent window as history for the next chunk
+		std::memmove(scratch.data(), &scratch[dest - WINDOW_SIZE], WINDOW_SIZE);
+		base += dest - WINDOW_SIZE;
+		dest = WINDOW_SIZE;
+	}
+}
+
+// one input compressed as separate segments, which can be done in any order and on any thread.
+// back-references may still reach into the previous segment, since the whole input is available
+// to each of them
+class SegmentedCompression {
+public:
+	SegmentedCompression(const std::vector<u8>& input, Level level) :
+		mInput(input), mLevel(level),
+		mStreams((input.size() + PARALLEL_SEGMENT_SIZE - 1) / PARALLEL_SEGMENT_SIZE),
+		mRemaining(mStreams.size()) {
+		mSegments.reserve(mStreams.size());
+		for (std::vector<u8>& stream : mStreams)
+			mSegments.emplace_back(stream);
+	}
+
+	u32 getSegmentCount() const { return mStreams.size(); }
+
+	// returns whether this was the last segment left to compress
+	bool compressSegment(u32 index) {
+		u32 start = index * PARALLEL_SEGMENT_SIZE;
+		u32 end = std::min<u32>(start + PARALLEL_SEGMENT_SIZE, mInput.size());
+		mStreams[index].reserve(end - start + (end - start) / 8 + 1);
+		compressRange(mSegments[index], mInput.data(), start, end, mLevel);
+		return --mRemaining == 0;
+	}
+
+	void join(std::vector<u8>& output, u32 alignment) {
+		size_t compressedSize = HEADER_SIZE;
+		for (const std::vector<u8>& stream : mStreams)
+			compressedSize += stream.size();
+
+		output.clear();
+		output.reserve(compressedSize);
+		output.resize(HEADER_SIZE);
+		writer::writeU32(output, 0x0, 0x59617a30, util::ByteOrder::Big);
+		writer::writeU32(output, 0x4, mInput.size(), util::ByteOrder::Big);
+		writer::writeU32(output, 0x8, alignment, util::ByteOrder::Big);
+
+		GroupWriter groups(output);
+		for (u32 i = 0; i < mSegments.size(); i++) {
+			groups.append(mSegments[i]);
+			std::vector<u8>().swap(mStreams[i]);
+		}
+	}
+
+private:
+	const std::vector<u8>& mInput;
+	const Level mLevel;
+	std::vector<std::vector<u8>> mStreams;
+	std::vector<GroupWriter> mSegments;
+	std::atomic<u32> mRemaining;
+};
+
+// indices of `buffers` from largest to smallest, so that the longest tasks in a batch are started
+// first instead of being left until the end
+std::vector<u32> largestFirst(const std::vector<std::vector<u8>>& buffers) {
+	std::vector<u32> order(buffers.size());
+	for (u32 i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) {
+		return buffers[a].size() > buffers[b].size();
+	});
+	return order;
+}
+
+} // namespace
+
+result_t getUncompressedSize(u32* out, std::span<const u8> input) {
+	if (input.size() < HEADER_SIZE) return Error::Truncated;
+
+	result_t r = reader::checkSignature(&input[0], "Yaz0", 4);
+	if (r) return r;
+
+	*out = reader::readU32(&input[4], util::ByteOrder::Big);
 	return 0;
 }
 
-void compress(std::vector<u8>& output, const std::vector<u8>& input, u32 alignment) {
+result_t decompress(std::span<u8> output, std::span<const u8> input) {
+	u32 uncompressedSize;
+	result_t r = getUncompressedSize(&uncompressedSize, input);
+	if (r) return r;
+
+	if (output.size() < uncompressedSize) return Error::OutputTooSmall;
+
+	size_t source = HEADER_SIZE;
+	u32 dest = 0;
+	return decodeGroups(
+		output.data(), uncompressedSize, uncompressedSize, input, &source, &dest
+	);
+}
+
+result_t decompressPrefix(std::span<u8> output, std::span<const u8> input) {
+	u32 uncompressedSize;
+	result_t r = getUncompressedSize(&uncompressedSize, input);
+	if (r) return r;
+
+	u32 size = std::min<size_t>(output.size(), uncompressedSize);
+	size_t source = HEADER_SIZE;
+	u32 dest = 0;
+	return decodeGroups(output.data(), size, size, input, &source, &dest);
+}
+
+result_t decompressPrefix(
+	std::span<u8> output, std::span<const u8> input, u32 size, size_t* source, u32* dest
+) {
+	u32 uncompressedSize;
+	result_t r = getUncompressedSize(&uncompressedSize, input);
+	if (r) return r;
+
+	// a back-reference is only cut short at the end of the file, so every call ends on a group
+	// boundary and the next one can carry on from it
+	if (output.size() < uncompressedSize) return Error::OutputTooSmall;
+	if (*source < HEADER_SIZE) *source = HEADER_SIZE;
+
+	size = std::min(size, uncompressedSize);
+	return decodeGroups(output.data(), size, uncompressedSize, input, source, dest);
+}
+
+result_t decompressRange(std::span<u8> output, std::span<const u8> input, u32 offset) {
+	u32 uncompressedSize;
+	result_t r = getUncompressedSize(&uncompressedSize, input);
+	if (r) return r;
+
+	if (offset > uncompressedSize || output.size() > uncompressedSize - offset)
+		return Error::OutOfRange;
+
+	return decodeRange(output, input, uncompressedSize, offset, HEADER_SIZE, 0, {});
+}
+
+result_t decompress(std::vector<u8>& output, const std::vector<u8>& input) {
+	u32 uncompressedSize;
+	result_t r = getUncompressedSize(&uncompressedSize, input);
+	if (r) return r;
+
+	output.resize(uncompressedSize);
+	return decompress(std::span<u8>(output), input);
+}
+
+void compress(
+	std::vector<u8>& output, const std::vector<u8>& input, u32 alignment, Level level
+) {
 	u32 uncompressedSize = input.size();
 
-	output.resize(0x10);
+	// worst case is every byte being a literal, plus one code byte per 8 literals
+	output.clear();
+	output.reserve(HEADER_SIZE + uncompressedSize + uncompressedSize / 8 + 1);
+	output.resize(HEADER_SIZE);
 	writer::writeU32(output, 0x0, 0x59617a30, util::ByteOrder::Big);
 	writer::writeU32(output, 0x4, uncompressedSize, util::ByteOrder::Big);
 	writer::writeU32(output, 0x8, alignment, util::ByteOrder::Big);
 
-	// TODO: remove candidates list and just keep track of first candidate,
-	// recomputing only when necessary
-	std::vector<u32> candidates;
-	candidates.reserve(0x1000);
+	GroupWriter groups(output);
+	compressRange(groups, input.data(), 0, uncompressedSize, level);
+}
 
-	std::vector<u8> chunk(24);
+void compressParallel(
+	std::vector<u8>& output, const std::vector<u8>& input, u32 alignment, Level level,
+	u32 threadCount
+) {
+	SegmentedCompression job(input, level);
 
-	u32 readPtr = 0;
-	u32 chunkDest = 0;
-	u32 bufferStart = 0;
+	if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, job.getSegmentCount());
+	if (threadCount <= 1) {
+		compress(output, input, alignment, level);
+		return;
+	}
 
-	while (readPtr < uncompressedSize) {
-		u8 codeByte = 0;
-		for (s32 i = 7; i >= 0; i--) {
-			std::fill(candidates.begin(), candidates.end(), 0);
+	util::ThreadPool pool(threadCount);
+	for (u32 i = 0; i < job.getSegmentCount(); i++)
+		pool.submit([&job, i] { job.compressSegment(i); });
+	pool.wait();
 
-			// add matching bytes from buffer to candidates list
-			for (u32 j = bufferStart; j < readPtr; j++) {
-				if (input.at(j) == input.at(readPtr)) candidates.push_back(j);
-			}
+	job.join(output, alignment);
+}
 
-			// find which candidate matches the most input bytes (max of 0x111 bytes)
-			s32 count;
-			u32 savedCandidate;
-			for (count = 0; count < 0x111; count++) {
-				savedCandidate = candidates.front();
-				if (candidates.empty() || (readPtr + count >= input.size())) break;
-
-				for (auto it = candidates.begin(); it != candidates.end();) {
-					if (input.at(readPtr + count) != input.at(*it + count))
-						it = candidates.erase(it);
-					else
-						++it;
-				}
-			}
+void compressBatch(
+	std::vector<std::vector<u8>>& outputs, const std::vector<std::vector<u8>>& inputs,
+	u32 alignment, Level level, u32 threadCount
+) {
+	outputs.resize(inputs.size());
+	std::vector<std::unique_ptr<SegmentedCompression>> jobs(inputs.size());
 
-			count--;
-			if (count < 3) {
-				// copy a single byte to output buffer
-				chunk.at(chunkDest++) = input.at(readPtr);
-				count = 1;
-				codeByte |= 1 << i;
-			} else {
-				// write compressed data to output buffer
-				u16 offset = readPtr - savedCandidate - 1;
-
-				if (count < 0x12) {
-					// 2-byte compressed data
-					u16 data = (count - 2) << 0xc | (offset & 0xfff);
-					writer::writeU16(chunk, chunkDest, data, util::ByteOrder::Big);
-					chunkDest += 2;
-				} else {
-					// 3-byte compressed data
-					u16 data = offset & 0xfff;
-					writer::writeU16(chunk, chunkDest, data, util::ByteOrder::Big);
-					chunkDest += 2;
-					chunk.at(chunkDest++) = count - 0x12;
+	util::ThreadPool pool(threadCount);
+	for (u32 i : largestFirst(inputs)) {
+		if (inputs[i].size() <= PARALLEL_SEGMENT_SIZE) {
+			pool.submit([&, i] { compress(outputs[i], inputs[i], alignment, level); });
+			continue;
+		}
+
+		// large inputs are split up so that the other threads can help with them. whichever
+		// segment finishes last joins them together
+		jobs[i] = std::make_unique<SegmentedCompression>(inputs[i], level);
+		for (u32 segment = 0; segment < jobs[i]->getSegmentCount(); segment++) {
+			pool.submit([&, i, segment] {
+				if (jobs[i]->compressSegment(segment)) {
+					jobs[i]->join(outputs[i], alignment);
+					jobs[i].reset();
 				}
-			}
+			});
+		}
+	}
+	pool.wait();
+}
+
+result_t decompressBatch(
+	std::vector<std::vector<u8>>& outputs, const std::vector<std::vector<u8>>& inputs,
+	u32 threadCount
+) {
+	outputs.resize(inputs.size());
+	std::vector<result_t> results(inputs.size());
+
+	util::ThreadPool pool(threadCount);
+	for (u32 i : largestFirst(inputs))
+		pool.submit([&, i] { results[i] = decompress(outputs[i], inputs[i]); });
+	pool.wait();
+
+	for (result_t r : results)
+		if (r) return r;
+	return 0;
+}
+
+result_t Decoder::decode(
+	size_t* consumed, size_t* produced, std::span<const u8> input, std::span<u8> output
+) {
+	size_t source = 0;
+	size_t dest = 0;
+	result_t r = 0;
+
+	auto emit = [&](u8 value) {
+		output[dest++] = value;
+		mWindow[mOutputPos++ % WINDOW_SIZE] = value;
+	};
+
+	while (!isHeaderRead() && source < input.size()) {
+		mHeader[mHeaderSize++] = input[source++];
+		if (isHeaderRead()) r = readHeader();
+	}
 
-			readPtr += count;
-			bufferStart = std::max(0u, readPtr - 0x1000);
+	while (r == 0 && isHeaderRead()) {
+		// finish the back-reference left over from the last output chunk first
+		while (mCopyCount > 0 && dest < output.size()) {
+			emit(mWindow[(mOutputPos - mCopyDistance) % WINDOW_SIZE]);
+			mCopyCount--;
+		}
+
+		if (mCopyCount > 0 || isFinished() || dest == output.size()) break;
 
-			if (readPtr >= input.size()) break;
+		if (mBitsLeft == 0) {
+			if (source == input.size()) break;
+			mCodeByte = input[source++];
+			mBitsLeft = 8;
 		}
 
-		// write code byte and then chunk to output
-		output.push_back(codeByte);
-		for (u32 i = 0; i < chunkDest; i++) {
-			output.push_back(chunk.at(i));
+		bool isCopy = (mCodeByte >> (mBitsLeft - 1)) & 0x01;
+		if (isCopy) {
+			if (source == input.size()) break;
+			emit(input[source++]);
+			mBitsLeft--;
+			continue;
 		}
-		chunkDest = 0;
+
+		// a back-reference may be split across input chunks, so gather its bytes first
+		while (mTokenSize < 2 && source < input.size())
+			mToken[mTokenSize++] = input[source++];
+		if (mTokenSize == 2 && (mToken[0] >> 4) == 0 && source < input.size())
+			mToken[mTokenSize++] = input[source++];
+		if (mTokenSize < 2 || ((mToken[0] >> 4) == 0 && mTokenSize < 3)) break;
+
+		u32 count = mToken[0] >> 4;
+		if (count == 0)
+			count = mToken[2] + 0x12;
+		else
+			count += 2;
+
+		mCopyDistance = (((mToken[0] & 0xf) << 8) | mToken[1]) + 1;
+		if (mCopyDistance > mOutputPos) {
+			r = Error::InvalidOffset;
+			break;
+		}
+
+		mCopyCount = std::min(count, mUncompressedSize - mOutputPos);
+		mTokenSize = 0;
+		mBitsLeft--;
+	}
+
+	*consumed = source;
+	*produced = dest;
+	return r;
+}
+
+result_t Decoder::readHeader() {
+	result_t r = reader::checkSignature(mHeader.data(), "Yaz0", 4);
+	if (r) return r;
+
+	mUncompressedSize = reader::readU32(&mHeader[4], util::ByteOrder::Big);
+	mAlignment = reader::readU32(&mHeader[8], util::ByteOrder::Big);
+	return 0;
+}
+
+result_t SeekIndex::build(std::span<const u8> input, u32 interval) {
+	result_t r = getUncompressedSize(&mUncompressedSize, input);
+	if (r) return r;
+
+	mCompressedSize = input.size();
+	mInterval = std::max(interval, WINDOW_SIZE);
+	mCheckpoints.clear();
+	mWindows.clear();
+
+	std::vector<u8> scratch(WINDOW_SIZE + mInterval + MAX_GROUP_OUTPUT);
+	size_t source = HEADER_SIZE;
+	u32 base = 0;
+	u32 dest = 0;
+
+	mCheckpoints.push_back({ HEADER_SIZE, 0, 0 });
+	while (base + dest < mUncompressedSize) {
+		// decoding stops at the first group boundary after each interval, which is where the next
+		// checkpoint goes
+		u32 stop = std::min(dest + mInterval, mUncompressedSize - base);
+		u32 end = std::min<u32>(scratch.size(), mUncompressedSize - base);
+		r = decodeGroups(scratch.data(), stop, end, input, &source, &dest);
+		if (r) return r;
+
+		u32 windowSize = std::min(dest, WINDOW_SIZE);
+		if (base + dest < mUncompressedSize) {
+			mCheckpoints.push_back({ (u32)source, base + dest, (u32)mWindows.size() });
+			mWindows.insert(
+				mWindows.end(), scratch.begin() + dest - windowSize, scratch.begin() + dest
+			);
+		}
+
+		std::memmove(scratch.data(), &scratch[dest - windowSize], windowSize);
+		base += dest - windowSize;
+		dest = windowSize;
+	}
+
+	return 0;
+}
+
+result_t SeekIndex::load(std::span<const u8> data) {
+	if (data.size() < 0x14) return Error::Truncated;
+
+	result_t r = reader::checkSignature(&data[0], "YIDX", 4);
+	if (r) return r;
+
+	mCompressedSize = reader::readU32LE(&data[0x4]);
+	mUncompressedSize = reader::readU32LE(&data[0x8]);
+	mInterval = reader::readU32LE(&data[0xc]);
+	u32 checkpointCount = reader::readU32LE(&data[0x10]);
+
+	mCheckpoints.clear();
+	mWindows.clear();
+
+	// the index may come from a file cached on disk, so every checkpoint is checked before
+	// `decompressRange` relies on it
+	if (mCompressedSize < HEADER_SIZE || checkpointCount == 0) return Error::InvalidIndex;
+
+	size_t offset = 0x14;
+	for (u32 i = 0; i < checkpointCount; i++) {
+		if (offset + 8 > data.size()) return Error::Truncated;
+
+		Checkpoint checkpoint;
+		checkpoint.mInputOffset = reader::readU32LE(&data[offset]);
+		checkpoint.mOutputOffset = reader::readU32LE(&data[offset + 4]);
+		checkpoint.mWindowOffset = mWindows.size();
+		offset += 8;
+
+		if (i == 0) {
+			if (checkpoint.mInputOffset != HEADER_SIZE || checkpoint.mOutputOffset != 0)
+				return Error::InvalidIndex;
+		} else {
+			const Checkpoint& previous = mCheckpoints.back();
+			bool isOrdered = checkpoint.mInputOffset > previous.mInputOffset &&
+			                 checkpoint.mOutputOffset > previous.mOutputOffset;
+			bool isInRange = checkpoint.mInputOffset < mCompressedSize &&
+			                 checkpoint.mOutputOffset < mUncompressedSize;
+			if (!isOrdered || !isInRange) return Error::InvalidIndex;
+		}
+
+		u32 windowSize = std::min(checkpoint.mOutputOffset, WINDOW_SIZE);
+		if (offset + windowSize > data.size()) return Error::Truncated;
+		std::span<const u8> window = data.subspan(offset, windowSize);
+		mWindows.insert(mWindows.end(), window.begin(), window.end());
+		offset += windowSize;
+
+		mCheckpoints.push_back(checkpoint);
+	}
+
+	return 0;
+}
+
+void SeekIndex::save(std::vector<u8>& out) const {
+	out.clear();
+	out.reserve(0x14 + 8 * mCheckpoints.size() + mWindows.size());
+
+	writer::writeString(out, 0x0, "YIDX", false);
+	writer::writeU32LE(out, 0x4, mCompressedSize);
+	writer::writeU32LE(out, 0x8, mUncompressedSize);
+	writer::writeU32LE(out, 0xc, mInterval);
+	writer::writeU32LE(out, 0x10, mCheckpoints.size());
+
+	for (const Checkpoint& checkpoint : mCheckpoints) {
+		u32 windowSize = std::min(checkpoint.mOutputOffset, WINDOW_SIZE);
+		writer::writeU32LE(out, out.size(), checkpoint.mInputOffset);
+		writer::writeU32LE(out, out.size(), checkpoint.mOutputOffset);
+		auto window = mWindows.begin() + checkpoint.mWindowOffset;
+		out.insert(out.end(), window, window + windowSize);
+	}
+}
+
+result_t SeekIndex::decompressRange(
+	std::span<u8> output, std::span<const u8> input, u32 offset
+) const {
+	if (input.size() != mCompressedSize || mCheckpoints.empty()) return Error::IndexMismatch;
+
+	u32 uncompressedSize;
+	result_t r = getUncompressedSize(&uncompressedSize, input);
+	if (r) return r;
+	if (uncompressedSize != mUncompressedSize) return Error::IndexMismatch;
+
+	if (offset > uncompressedSize || output.size() > uncompressedSize - offset)
+		return Error::OutOfRange;
+
+	// the last checkpoint at or before the start of the range
+	auto it = std::upper_bound(
+		mCheckpoints.begin(), mCheckpoints.end(), offset,
+		[](u32 offset, const Checkpoint& checkpoint) { return offset < checkpoint.mOutputOffset; }
+	);
+	if (it == mCheckpoints.begin()) return Error::IndexMismatch;
+	const Checkpoint& checkpoint = *std::prev(it);
+
+	u32 windowSize = std::min(checkpoint.mOutputOffset, WINDOW_SIZE);
+	std::span<const u8> history =
+		std::span(mWindows).subspan(checkpoint.mWindowOffset, windowSize);
+	return decodeRange(
+		output, input, uncompressedSize, offset, checkpoint.mInputOffset,
+		checkpoint.mOutputOffset, history
+	);
+}
+
+void Cache::compress(
+	std::vector<u8>& output, const std::vector<u8>& input, u32 alignment, Level level
+) {
+	u64 hash = util::hash64(input, (u64)alignment << 8 | (u64)level);
+	char filename[0x20];
+	snprintf(filename, sizeof(filename), "%016llx.yaz0", (unsigned long long)hash);
+	fs::path path = mDir / filename;
+
+	if (read(output, path, input.size(), alignment)) return;
+
+	yaz0::compress(output, input, alignment, level);
+	write(path, output);
+}
+
+bool Cache::read(
+	std::vector<u8>& output, const fs::path& path, u32 uncompressedSize, u32 alignment
+) {
+	std::error_code error;
+	if (!fs::is_regular_file(path, error)) return false;
+
+	std::vector<u8> contents;
+	if (util::readFile(contents, path) != 0 || contents.size() < HEADER_SIZE + TRAILER_SIZE)
+		return false;
+
+	// the trailer catches entries which were truncated or corrupted after they were written
+	size_t size = contents.size() - TRAILER_SIZE;
+	if (reader::readU64LE(&contents[size]) != size) return false;
+	std::span<const u8> data(contents.data(), size);
+	if (reader::readU64LE(&contents[size + 8]) != util::hash64(data)) return false;
+
+	// guard against hash collisions as far as the header allows
+	u32 cachedSize;
+	if (getUncompressedSize(&cachedSize, data) != 0 || cachedSize != uncompressedSize)
+		return false;
+	if (reader::readU32BE(&contents[8]) != alignment) return false;
+
+	// the modification time doubles as the last use time for eviction
+	fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+	contents.resize(size);
+	output = std::move(contents);
+	return true;
+}
+
+void Cache::write(const fs::path& path, const std::vector<u8>& output) {
+	std::error_code error;
+	fs::create_directories(mDir, error);
+
+	// write under a temporary name which is unique to this write first, so that other processes
+	// sharing the cache never see a partially written entry
+	static std::atomic<u32> writeCount = 0;
+	std::random_device random;
+	char suffix[0x20];
+	snprintf(
+		suffix, sizeof(suffix), ".%08x%08x.tmp", (unsigned)random(),
+		(unsigned)writeCount.fetch_add(1)
+	);
+	fs::path tempPath = path;
+	tempPath += suffix;
+
+	std::vector<u8> trailer;
+	writer::writeU64LE(trailer, 0, output.size());
+	writer::writeU64LE(trailer, 8, util::hash64(output));
+
+	std::ofstream fstream(tempPath, std::ios::out | std::ios::binary);
+	fstream.write(reinterpret_cast<const char*>(output.data()), output.size());
+	fstream.write(reinterpret_cast<const char*>(trailer.data()), trailer.size());
+	fstream.close();
+
+	// only a complete entry is moved into place
+	if (!fstream) {
+		fs::remove(tempPath, error);
+		return;
+	}
+
+	fs::rename(tempPath, path, error);
+	if (error) {
+		fs::remove(tempPath, error);
+		return;
+	}
+
+	evict();
+}
+
+void Cache::evict() {
+	struct Entry {
+		fs::path mPath;
+		fs::file_time_type mLastUsed;
+		u64 mSize;
+	};
+
+	std::error_code error;
+	std::vector<Entry> entries;
+	u64 totalSize = 0;
+	const fs::file_time_type now = fs::file_time_type::clock::now();
+	for (const fs::directory_entry& file : fs::directory_iterator(mDir, error)) {
+		if (!file.is_regular_file(error)) continue;
+
+		const fs::path extension = file.path().extension();
+		if (extension != ".yaz0" && extension != ".tmp") continue;
+
+		Entry entry = { file.path(), file.last_write_time(error), file.file_size(error) };
+		if (error) continue;
+
+		// temporary files still count towards the size, since they may be left behind
+		if (extension == ".tmp" && now - entry.mLastUsed > CACHE_TEMP_MAX_AGE) {
+			fs::remove(entry.mPath, error);
+			continue;
+		}
+
+		totalSize += entry.mSize;
+		if (extension == ".yaz0") entries.push_back(entry);
+	}
+
+	if (totalSize <= mMaxSize) return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.mLastUsed < b.mLastUsed;
+	});
+
+	for (const Entry& entry : entries) {
+		if (totalSize <= mMaxSize) break;
+		if (fs::remove(entry.mPath, error)) totalSize -= entry.mSize;
 	}
 }
 